@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * bench-residency: compares the residency vector scanning kernels (counting
+ * the resident pages & finding the slices boundaries) with the byte at a time
+ * loops on large synthetic mincore() vectors.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "errwarn.h"
+#include "residency.h"
+
+const char progname[] = "bench-residency";
+
+/* Minimum time spent on each measurement, in seconds */
+static const double min_time = 0.2;
+
+enum fill {
+	FILL_RANDOM,		/* each page resident with 50% probability */
+	FILL_RUNS,		/* runs of 1 to 512 pages */
+	FILL_FULL,
+	FILL_EMPTY,
+	FILL_COUNT
+};
+const char *fill_names[FILL_COUNT] = { "random", "runs", "full", "empty" };
+
+void fill(unsigned char *, size_t, enum fill);
+double now(void);
+size_t count_bytewise(const unsigned char *, size_t);
+size_t slices_bytewise(const struct residency_kernel *,
+    const unsigned char *, size_t);
+size_t slices_kernel(const struct residency_kernel *, const unsigned char *,
+    size_t);
+double measure(size_t (*)(const struct residency_kernel *,
+    const unsigned char *, size_t), const struct residency_kernel *,
+    const unsigned char *, size_t, size_t *);
+size_t count_with(const struct residency_kernel *, const unsigned char *,
+    size_t);
+size_t count_bytewise_with(const struct residency_kernel *,
+    const unsigned char *, size_t);
+
+int main(int argc, char *argv[])
+{
+	const struct residency_kernel	*k;
+	unsigned char			*vec;
+	size_t				 n = 64 * 1024 * 1024, rc, rs, c, s;
+	double				 tc0, ts0, tc, ts;
+	int				 f;
+
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [pages]\n", progname);
+		exit(1);
+	}
+	if (argc == 2 && (n = (size_t) strtoull(argv[1], NULL, 0)) == 0)
+		error(1, -1, "Invalid number of pages: '%s'", argv[1]);
+
+	vec = malloc(n);
+	if (vec == NULL)
+		error(1, errno, "Unable to allocate vec[%lu]",
+		    (unsigned long) n);
+
+	printf("%lu pages, GB/s of vector (speedup over a byte at a time)\n",
+	    (unsigned long) n);
+	printf("%-8s %-9s %16s %16s\n", "vector", "kernel", "count",
+	    "slices");
+	for (f = 0; f < FILL_COUNT; f++) {
+		fill(vec, n, (enum fill) f);
+		tc0 = measure(count_bytewise_with, NULL, vec, n, &rc);
+		ts0 = measure(slices_bytewise, NULL, vec, n, &rs);
+		printf("%-8s %-9s %9.2f        %9.2f\n", fill_names[f],
+		    "bytewise", (double) n / tc0 / 1e9, (double) n / ts0 / 1e9);
+
+		for (k = residency_kernels; k->name != NULL; k++) {
+			if (!k->supported())
+				continue;
+			tc = measure(count_with, k, vec, n, &c);
+			ts = measure(slices_kernel, k, vec, n, &s);
+			if (c != rc || s != rs)
+				error(2, -1, "'%s' kernel mismatch on '%s': "
+				    "%lu/%lu pages, %lu/%lu slices", k->name,
+				    fill_names[f], (unsigned long) c,
+				    (unsigned long) rc, (unsigned long) s,
+				    (unsigned long) rs);
+			printf("%-8s %-9s %9.2f (x%4.1f) %9.2f (x%4.1f)\n",
+			    fill_names[f], k->name, (double) n / tc / 1e9,
+			    tc0 / tc, (double) n / ts / 1e9, ts0 / ts);
+		}
+	}
+	free(vec);
+
+	return (0);
+}
+
+
+void
+fill(unsigned char *vec, size_t n, enum fill how)
+{
+	size_t		 k = 0, len;
+	unsigned	 seed = 1;
+	unsigned char	 v = 0;
+
+	switch (how) {
+	case FILL_FULL:
+	case FILL_EMPTY:
+		/* Other bits set as mincore() may do */
+		memset(vec, how == FILL_FULL ? 0x03 : 0x02, n);
+		break;
+	case FILL_RUNS:
+		while (k < n) {
+			len = 1 + (size_t) (rand_r(&seed) % 512);
+			if (len > n - k)
+				len = n - k;
+			memset(vec + k, v, len);
+			k += len;
+			v ^= 1;
+		}
+		break;
+	case FILL_RANDOM:
+	default:
+		for (k = 0; k < n; k++)
+			vec[k] = (unsigned char) (rand_r(&seed) & 1);
+		break;
+	}
+}
+
+
+double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((double) ts.tv_sec + (double) ts.tv_nsec / 1e9);
+}
+
+
+/* The loops used before the kernels */
+size_t
+count_bytewise(const unsigned char *vec, size_t n)
+{
+	size_t k, pim = 0;
+
+	for (k = 0; k < n; k++) {
+		if (vec[k] & 1)
+			pim++;
+	}
+
+	return (pim);
+}
+
+
+size_t
+count_bytewise_with(const struct residency_kernel *k,
+    const unsigned char *vec, size_t n)
+{
+	(void) k;
+
+	return (count_bytewise(vec, n));
+}
+
+
+size_t
+count_with(const struct residency_kernel *k, const unsigned char *vec,
+    size_t n)
+{
+	return (k->count(vec, n));
+}
+
+
+size_t
+slices_bytewise(const struct residency_kernel *kern,
+    const unsigned char *vec, size_t n)
+{
+	size_t	k, nslices = 0;
+	int	in_a_slice = 0;
+
+	(void) kern;
+	for (k = 0; k < n; k++) {
+		if (vec[k] & 1) {
+			if (!in_a_slice)
+				nslices++;
+			in_a_slice = 1;
+		} else
+			in_a_slice = 0;
+	}
+
+	return (nslices);
+}
+
+
+/* As slices-in-pagecache does */
+size_t
+slices_kernel(const struct residency_kernel *kern, const unsigned char *vec,
+    size_t n)
+{
+	size_t k = 0, nslices = 0;
+
+	while (k < n) {
+		k = kern->find(vec, k, n, 1);
+		if (k == n)
+			break;
+		nslices++;
+		k = kern->find(vec, k, n, 0);
+	}
+
+	return (nslices);
+}
+
+
+/* Seconds per pass, the result of the last pass in '*res' */
+double
+measure(size_t (*fn)(const struct residency_kernel *, const unsigned char *,
+    size_t), const struct residency_kernel *k, const unsigned char *vec,
+    size_t n, size_t *res)
+{
+	double		 t0 = now(), t;
+	unsigned long	 passes = 0;
+
+	do {
+		*res = fn(k, vec, n);
+		passes++;
+		t = now() - t0;
+	} while (t < min_time);
+
+	return (t / (double) passes);
+}
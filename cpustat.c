@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Per thread CPU accounting: the rusage of the calling thread (the whole
+ * process where RUSAGE_THREAD is not available) & perf software counters
+ * restricted to the calling thread.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE	/* RUSAGE_THREAD */
+#endif /* __linux__ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpustat.h"
+
+#if defined(__linux__) && defined(__NR_perf_event_open)
+#define HAVE_PERF_EVENT
+#include <linux/perf_event.h>
+#endif
+
+#ifdef RUSAGE_THREAD
+#define RUSAGE_WHO	RUSAGE_THREAD
+#else
+#define RUSAGE_WHO	RUSAGE_SELF
+#endif /* RUSAGE_THREAD */
+
+const char *cpu_counter_names[CPU_NCOUNTERS] = {
+	"page_faults", "major_faults", "cpu_clock_ns", "context_switches"
+};
+
+#ifdef HAVE_PERF_EVENT
+static const uint64_t perf_configs[CPU_NCOUNTERS] = {
+	PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_PAGE_FAULTS_MAJ,
+	PERF_COUNT_SW_CPU_CLOCK, PERF_COUNT_SW_CONTEXT_SWITCHES
+};
+#endif /* HAVE_PERF_EVENT */
+
+static double tv_seconds(const struct timeval *);
+
+
+/*
+ * Opens the (disabled) perf counters of the calling thread, user space only
+ * when kernel profiling is not permitted.  Returns 0, or -1 with errno set
+ * when they are unavailable (the rusage is collected anyway).
+ */
+int
+cpuprobe_open(struct cpuprobe *p)
+{
+#ifdef HAVE_PERF_EVENT
+	struct perf_event_attr	 attr;
+	int			 c, serrno;
+#endif /* HAVE_PERF_EVENT */
+
+	memset(p, 0, sizeof(*p));
+	p->fds[0] = -1;
+
+#ifdef HAVE_PERF_EVENT
+	for (c = 0; c < CPU_NCOUNTERS; c++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_SOFTWARE;
+		attr.size = sizeof(attr);
+		attr.config = perf_configs[c];
+		attr.disabled = 1;
+		p->fds[c] = (int) syscall(__NR_perf_event_open, &attr, 0, -1,
+		    -1, 0UL);
+		if (p->fds[c] == -1 && (errno == EACCES || errno == EPERM)) {
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			p->user_only = 1;
+			p->fds[c] = (int) syscall(__NR_perf_event_open, &attr,
+			    0, -1, -1, 0UL);
+		}
+		if (p->fds[c] == -1) {
+			serrno = errno;
+			while (c-- > 0)
+				close(p->fds[c]);
+			p->fds[0] = -1;
+			errno = serrno;
+			return (-1);
+		}
+	}
+
+	return (0);
+#else
+	errno = ENOSYS;
+
+	return (-1);
+#endif /* HAVE_PERF_EVENT */
+}
+
+
+void
+cpuprobe_start(struct cpuprobe *p)
+{
+#ifdef HAVE_PERF_EVENT
+	int c;
+
+	for (c = 0; p->fds[0] != -1 && c < CPU_NCOUNTERS; c++) {
+		ioctl(p->fds[c], PERF_EVENT_IOC_RESET, 0);
+		ioctl(p->fds[c], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif /* HAVE_PERF_EVENT */
+	getrusage(RUSAGE_WHO, &p->ru);
+}
+
+
+/* What was used since cpuprobe_start(), the counters are closed */
+void
+cpuprobe_stop(struct cpuprobe *p, struct cpustat *cs)
+{
+	struct rusage	 ru;
+#ifdef HAVE_PERF_EVENT
+	uint64_t	 v;
+	int		 c;
+#endif /* HAVE_PERF_EVENT */
+
+	getrusage(RUSAGE_WHO, &ru);
+	memset(cs, 0, sizeof(*cs));
+	cs->utime = tv_seconds(&ru.ru_utime) - tv_seconds(&p->ru.ru_utime);
+	cs->stime = tv_seconds(&ru.ru_stime) - tv_seconds(&p->ru.ru_stime);
+	cs->minflt = ru.ru_minflt - p->ru.ru_minflt;
+	cs->majflt = ru.ru_majflt - p->ru.ru_majflt;
+	cs->nvcsw = ru.ru_nvcsw - p->ru.ru_nvcsw;
+	cs->nivcsw = ru.ru_nivcsw - p->ru.ru_nivcsw;
+
+#ifdef HAVE_PERF_EVENT
+	if (p->fds[0] == -1)
+		return;
+
+	cs->perf = 1;
+	cs->user_only = p->user_only;
+	for (c = 0; c < CPU_NCOUNTERS; c++) {
+		v = 0;
+		ioctl(p->fds[c], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(p->fds[c], &v, sizeof(v)) != (ssize_t) sizeof(v))
+			cs->perf = 0;
+		cs->counters[c] = v;
+		close(p->fds[c]);
+	}
+	p->fds[0] = -1;
+#endif /* HAVE_PERF_EVENT */
+}
+
+
+/* The total counters are valid if they were for all the parts */
+void
+cpustat_add(struct cpustat *total, const struct cpustat *cs)
+{
+	int c;
+
+	total->perf = total->perf && cs->perf;
+	total->user_only = total->user_only || cs->user_only;
+	total->utime += cs->utime;
+	total->stime += cs->stime;
+	total->minflt += cs->minflt;
+	total->majflt += cs->majflt;
+	total->nvcsw += cs->nvcsw;
+	total->nivcsw += cs->nivcsw;
+	for (c = 0; c < CPU_NCOUNTERS; c++)
+		total->counters[c] += cs->counters[c];
+}
+
+
+double
+tv_seconds(const struct timeval *tv)
+{
+	return ((double) tv->tv_sec + (double) tv->tv_usec / 1e6);
+}
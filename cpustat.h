@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * CPU time, page faults & context switches of a thread between two points,
+ * from getrusage() & (where permitted) perf_event_open() software counters.
+ */
+
+#ifndef __CPUSTAT_H__
+#define __CPUSTAT_H__
+
+#include <sys/resource.h>
+
+#include <stdint.h>
+
+enum cpu_counter {
+	CPU_PAGE_FAULTS,
+	CPU_MAJOR_FAULTS,
+	CPU_CLOCK,			/* ns */
+	CPU_CONTEXT_SWITCHES,
+	CPU_NCOUNTERS
+};
+
+struct cpustat {
+	double			 utime;		/* s */
+	double			 stime;		/* s */
+	long			 minflt;
+	long			 majflt;
+	long			 nvcsw;
+	long			 nivcsw;
+	int			 perf;		/* counters below are valid */
+	int			 user_only;	/* counters exclude the kernel */
+	uint64_t		 counters[CPU_NCOUNTERS];
+};
+
+struct cpuprobe {
+	struct rusage		 ru;
+	int			 fds[CPU_NCOUNTERS];
+	int			 user_only;
+};
+
+extern const char *cpu_counter_names[CPU_NCOUNTERS];
+
+extern int cpuprobe_open(struct cpuprobe *);
+extern void cpuprobe_start(struct cpuprobe *);
+extern void cpuprobe_stop(struct cpuprobe *, struct cpustat *);
+extern void cpustat_add(struct cpustat *, const struct cpustat *);
+
+#endif /* __CPUSTAT_H__ */
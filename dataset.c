@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Datasets: regular files given directly, found (recursively) in
+ * directories or listed in a file, one path per line.
+ * Symbolic links are not followed, like for a single file.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dataset.h"
+#include "errwarn.h"
+
+static int add_file(struct dataset *, const char *, off_t);
+static int add_dir(struct dataset *, const char *);
+static int namecmp(const void *, const void *);
+static void fdcache_evict(struct fdcache *);
+static void ofile_close(struct ofile *);
+
+
+void
+dataset_init(struct dataset *ds)
+{
+	memset(ds, 0, sizeof(*ds));
+}
+
+
+int
+add_file(struct dataset *ds, const char *path, off_t size)
+{
+	struct dsfile *f;
+
+	if (ds->nfiles == ds->alloc) {
+		size_t n = ds->alloc ? ds->alloc * 2 : 64;
+
+		f = realloc(ds->files, n * sizeof(*f));
+		if (f == NULL)
+			return (-1);
+		ds->files = f;
+		ds->alloc = n;
+	}
+
+	f = &ds->files[ds->nfiles];
+	memset(f, 0, sizeof(*f));
+	f->path = strdup(path);
+	if (f->path == NULL)
+		return (-1);
+	f->size = size;
+	ds->nfiles++;
+
+	return (0);
+}
+
+
+int
+namecmp(const void *a, const void *b)
+{
+	return (strcmp(*(char * const *) a, *(char * const *) b));
+}
+
+
+/*
+ * Adds the regular files found in the directory & its sub-directories, in
+ * name order so that the dataset layout does not depend on the directory
+ * entries order.
+ */
+int
+add_dir(struct dataset *ds, const char *path)
+{
+	struct dirent	 *de;
+	struct stat	  st;
+	DIR		 *dir;
+	char		**names = NULL, *p;
+	size_t		  n = 0, alloc = 0, k, len;
+	int		  rc = 0;
+
+	dir = opendir(path);
+	if (dir == NULL) {
+		warning(errno, "Unable to open directory '%s'", path);
+		return (0);
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0
+		    || strcmp(de->d_name, "..") == 0)
+			continue;
+
+		if (n == alloc) {
+			char **nn;
+
+			alloc = alloc ? alloc * 2 : 64;
+			nn = realloc(names, alloc * sizeof(*names));
+			if (nn == NULL) {
+				rc = -1;
+				break;
+			}
+			names = nn;
+		}
+		len = strlen(path) + strlen(de->d_name) + 2;
+		names[n] = malloc(len);
+		if (names[n] == NULL) {
+			rc = -1;
+			break;
+		}
+		snprintf(names[n], len, "%s/%s", path, de->d_name);
+		n++;
+	}
+	closedir(dir);
+
+	if (rc == 0)
+		qsort(names, n, sizeof(*names), namecmp);
+
+	for (k = 0; k < n; k++) {
+		p = names[k];
+		if (rc == 0) {
+			if (lstat(p, &st) == -1)
+				warning(errno, "Unable to stat '%s'", p);
+			else if (S_ISDIR(st.st_mode))
+				rc = add_dir(ds, p);
+			else if (S_ISREG(st.st_mode))
+				rc = add_file(ds, p, st.st_size);
+		}
+		free(p);
+	}
+	free(names);
+
+	return (rc);
+}
+
+
+/*
+ * Adds a regular file or the content of a directory.  Returns -1 with errno
+ * set on failure (inaccessible entries in directories are only reported).
+ */
+int
+dataset_add(struct dataset *ds, const char *path)
+{
+	struct stat st;
+
+	if (lstat(path, &st) == -1)
+		return (-1);
+
+	if (S_ISDIR(st.st_mode))
+		return (add_dir(ds, path));
+
+	if (!S_ISREG(st.st_mode)) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	return (add_file(ds, path, st.st_size));
+}
+
+
+/* Adds the files & directories listed in 'list' ("-" for stdin) */
+int
+dataset_add_list(struct dataset *ds, const char *list)
+{
+	FILE	*fp;
+	char	 line[4096];
+	size_t	 len;
+	int	 rc = 0;
+
+	fp = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+	if (fp == NULL)
+		return (-1);
+
+	while (rc == 0 && fgets(line, sizeof(line), fp) != NULL) {
+		len = strlen(line);
+		while (len > 0 && (line[len - 1] == '\n'
+		    || line[len - 1] == '\r'))
+			line[--len] = '\0';
+		if (len == 0 || line[0] == '#')
+			continue;
+
+		if (dataset_add(ds, line) == -1) {
+			warning(errno, "Unable to add '%s'", line);
+			continue;
+		}
+	}
+	if (ferror(fp))
+		rc = -1;
+	if (fp != stdin)
+		fclose(fp);
+
+	return (rc);
+}
+
+
+/*
+ * Restricts every file to the [start:start+length) window (length 0: up to
+ * the end of the file), drops the files with an empty window & lays out the
+ * windows in the dataset address space.
+ */
+void
+dataset_window(struct dataset *ds, off_t start, off_t length)
+{
+	struct dsfile	*f;
+	size_t		 i, n = 0;
+	off_t		 end;
+
+	ds->length = 0;
+	for (i = 0; i < ds->nfiles; i++) {
+		f = &ds->files[i];
+		f->start = start < f->size ? start : f->size;
+		end = length > 0 ? f->start + length : f->size;
+		if (end > f->size)
+			end = f->size;
+		f->length = end - f->start;
+
+		if (f->length == 0) {
+			free(f->path);
+			continue;
+		}
+		f->vstart = ds->length;
+		ds->length += f->length;
+		ds->files[n++] = *f;
+	}
+	ds->nfiles = n;
+}
+
+
+/* Index of the file which window contains dataset position 'vpos' */
+size_t
+dataset_locate(const struct dataset *ds, off_t vpos)
+{
+	size_t lo = 0, hi = ds->nfiles, mid;
+
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (ds->files[mid].vstart <= vpos)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return (lo);
+}
+
+
+void
+dataset_free(struct dataset *ds)
+{
+	size_t i;
+
+	for (i = 0; i < ds->nfiles; i++)
+		free(ds->files[i].path);
+	free(ds->files);
+	memset(ds, 0, sizeof(*ds));
+}
+
+
+/*
+ * 'limit' files at most are kept open (more if all of them have I/Os in
+ * flight), with 'flags'.  With 'advice' >= 0 the window of the files (plus
+ * 'map_extra' bytes, within the file) is also mapped & given that advice.
+ */
+int
+fdcache_init(struct fdcache *c, const struct dataset *ds, size_t limit,
+    int flags, int advice, size_t map_extra)
+{
+	size_t i;
+
+	memset(c, 0, sizeof(*c));
+	c->ds = ds;
+	c->limit = limit > 0 ? limit : 1;
+	c->flags = flags;
+	c->advice = advice;
+	c->map_extra = map_extra;
+
+	c->of = calloc(ds->nfiles, sizeof(*c->of));
+	c->open = calloc(ds->nfiles, sizeof(*c->open));
+	if (c->of == NULL || c->open == NULL) {
+		free(c->of);
+		free(c->open);
+		return (-1);
+	}
+	for (i = 0; i < ds->nfiles; i++)
+		c->of[i].fd = -1;
+
+	return (0);
+}
+
+
+void
+ofile_close(struct ofile *of)
+{
+	if (of->map != NULL)
+		munmap(of->map, of->map_len);
+	if (of->fd != -1)
+		close(of->fd);
+	of->map = NULL;
+	of->fd = -1;
+}
+
+
+/* Closes the least recently used idle file, if any */
+void
+fdcache_evict(struct fdcache *c)
+{
+	size_t		 k, victim = c->nopen;
+	uint64_t	 oldest = UINT64_MAX;
+
+	for (k = 0; k < c->nopen; k++) {
+		struct ofile *of = &c->of[c->open[k]];
+
+		if (of->busy == 0 && of->last_use < oldest) {
+			oldest = of->last_use;
+			victim = k;
+		}
+	}
+	if (victim == c->nopen)
+		return;
+
+	ofile_close(&c->of[c->open[victim]]);
+	c->open[victim] = c->open[--c->nopen];
+}
+
+
+/*
+ * Returns the open file (marked busy until fdcache_put()), opening it if
+ * needed.  Returns NULL with errno set on failure.
+ */
+struct ofile *
+fdcache_get(struct fdcache *c, size_t idx)
+{
+	const struct dsfile	*f = &c->ds->files[idx];
+	struct ofile		*of = &c->of[idx];
+	off_t			 end, pagesize;
+	int			 serrno;
+
+	if (of->fd == -1) {
+		if (c->nopen >= c->limit)
+			fdcache_evict(c);
+
+		of->fd = open(f->path, c->flags);
+		if (of->fd == -1)
+			return (NULL);
+
+		if (c->advice >= 0) {
+			pagesize = (off_t) sysconf(_SC_PAGESIZE);
+			end = f->start + f->length + (off_t) c->map_extra;
+			if (end > f->size)
+				end = f->size;
+			of->map_offset = f->start - f->start % pagesize;
+			of->map_len = (size_t) (end - of->map_offset);
+			of->map = mmap(NULL, of->map_len, PROT_READ,
+			    MAP_SHARED, of->fd, of->map_offset);
+			if (of->map == MAP_FAILED) {
+				serrno = errno;
+				of->map = NULL;
+				ofile_close(of);
+				errno = serrno;
+				return (NULL);
+			}
+			if (c->advice != MADV_NORMAL
+			    && madvise(of->map, of->map_len, c->advice) == -1)
+				warning(errno, "Unable to give madvise() "
+				    "advice for '%s'", f->path);
+		}
+		c->open[c->nopen++] = idx;
+	}
+	of->busy++;
+	of->last_use = ++c->clock;
+
+	return (of);
+}
+
+
+void
+fdcache_put(struct fdcache *c, size_t idx)
+{
+	if (c->of[idx].busy > 0)
+		c->of[idx].busy--;
+}
+
+
+void
+fdcache_fini(struct fdcache *c)
+{
+	size_t k;
+
+	for (k = 0; k < c->nopen; k++)
+		ofile_close(&c->of[c->open[k]]);
+	free(c->of);
+	free(c->open);
+	memset(c, 0, sizeof(*c));
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Sets of files read as a whole & cache of open descriptors.
+ */
+
+#ifndef __DATASET_H__
+#define __DATASET_H__
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+/*
+ * The windows of all the files are laid out one after the other in a
+ * single "dataset" address space, so that a position chosen uniformly in
+ * that space selects the files proportionally to their (window) size.
+ */
+struct dsfile {
+	char		*path;
+	off_t		 size;
+	off_t		 start;		/* window in the file */
+	off_t		 length;
+	off_t		 vstart;	/* window start in the dataset */
+};
+
+struct dataset {
+	struct dsfile	*files;
+	size_t		 nfiles;
+	size_t		 alloc;
+	off_t		 length;	/* sum of the windows lengths */
+};
+
+/* Open file, possibly mapped */
+struct ofile {
+	int		 fd;
+	unsigned	 busy;		/* I/Os in flight, not evictable */
+	uint64_t	 last_use;
+	unsigned char	*map;		/* mapping of [map_offset:] */
+	off_t		 map_offset;
+	size_t		 map_len;
+};
+
+/* Per-thread cache of open files, least recently used files are closed */
+struct fdcache {
+	const struct dataset	*ds;
+	struct ofile		*of;		/* one per file */
+	size_t			*open;		/* indices of the open files */
+	size_t			 nopen;
+	size_t			 limit;
+	int			 flags;		/* open() flags */
+	int			 advice;	/* madvise(), -1: no mapping */
+	size_t			 map_extra;	/* mapped past the window */
+	uint64_t		 clock;
+};
+
+extern void dataset_init(struct dataset *);
+extern int dataset_add(struct dataset *, const char *);
+extern int dataset_add_list(struct dataset *, const char *);
+extern void dataset_window(struct dataset *, off_t, off_t);
+extern size_t dataset_locate(const struct dataset *, off_t);
+extern void dataset_free(struct dataset *);
+
+extern int fdcache_init(struct fdcache *, const struct dataset *, size_t,
+    int, int, size_t);
+extern struct ofile *fdcache_get(struct fdcache *, size_t);
+extern void fdcache_put(struct fdcache *, size_t);
+extern void fdcache_fini(struct fdcache *);
+
+#endif /* __DATASET_H__ */
@@ -19,44 +19,230 @@
  * All these files must be readable by the user.  Files which are otherwise
  * accessed by a process (of the current user or another) are likely to be only
  * partially removed from the pagecache.
- * This is a hint given to the pagecache which is free to ignore it.
+ * This is a hint given to the pagecache which is free to ignore it.  Dirty
+ * pages (or pages under writeback) are not removed, they can be written first
+ * & the hint given again.  The pages in the pagecache before & after are
+ * counted to report what was actually removed.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE	/* sync_file_range() */
+#endif /* __linux__ */
+
 #include <sys/stat.h>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "errwarn.h"
+#include "residency.h"
+#include "util.h"
 
 const char progname[] = "drop-from-pagecache";
 
+struct drop {
+	struct residency	 r;
+	unsigned long long	 offset;	/* range of each file */
+	unsigned long long	 length;	/* 0 up to the end */
+	int			 sync;
+	int			 retries;
+	int			 cachestat;	/* still tried */
+	unsigned long long	 before;	/* pages, all files */
+	unsigned long long	 after;
+};
+
+void usage(FILE *);
+int count_pages(struct drop *, int, off_t, off_t, unsigned long long *,
+    struct residency_stat *);
+int sync_range(int, off_t, off_t);
+void drop_file(struct drop *, const char *);
+
+void usage(FILE *fp)
+{
+	fprintf(fp,
+"\nRemoves the content of files from the pagecache.\n"
+"\nUsage:\n"
+"%s [-O offset] [-L length] [-r retries] [-s] file ...\n"
+"\nWhere:\n"
+" -O offset: removes each file from offset.\n"
+" -L length: removes at most length bytes of each file.\n"
+" -r retries: number of times the pages still in the pagecache are removed\n"
+"    again (none by default).\n"
+" -s writes the dirty pages first (& waits for the writeback), as they can\n"
+"    not be removed otherwise.\n"
+"\nOffsets & lengths in bytes, or with a K, M, G or T suffix.\n"
+"The pages in the pagecache before & after are reported for each file.\n",
+	    progname);
+}
+
+
 int main(int argc, char *argv[])
 {
-	struct stat st;
-	int i, fd;
-
-	for (i = 1; i < argc; i++) {
-		fd = open(argv[i], O_RDONLY);
-		if (fd != -1) {
-			if (fstat(fd, &st) == -1) {
-				warning(errno, "Unable to stat '%s'", argv[i]);
-				continue;
-			}
-			if (st.st_size > 0 && posix_fadvise(fd, 0, st.st_size,
-			    POSIX_FADV_DONTNEED) != 0) {
-				warning(errno, "Unable to give cache hint for "
-				    "'%s'", argv[i]);
-				continue;
-			}
-			if (close(fd) == -1)
-				warning(errno, "Problem closing '%s'", argv[i]);
-		} else
-			warning(errno, "Unable to open '%s'", argv[i]);
+	struct drop	 d;
+	int		 i, ch;
+
+	memset(&d, 0, sizeof(d));
+	d.cachestat = 1;
+	while ((ch = getopt(argc, argv, ":hL:O:r:s")) != -1) {
+		switch (ch) {
+		case 'h':
+			usage(stdout);
+			exit(0);
+		case 'L':
+			d.length = parse_size(optarg);
+			break;
+		case 'O':
+			d.offset = parse_size(optarg);
+			break;
+		case 'r':
+			d.retries = atoi(optarg);
+			if (d.retries < 0)
+				error(1, -1, "Invalid number of retries: '%s'",
+				    optarg);
+			break;
+		case 's':
+			d.sync = 1;
+			break;
+		case ':':
+			usage(stderr);
+			error(1, -1, "Option -%c requires an argument", optopt);
+			break;
+		default:
+			usage(stderr);
+			error(1, -1, "Unknown option: -%c", optopt);
+			break;
+		}
 	}
+	if (residency_init(&d.r) == -1)
+		error(1, errno, "Unable to get pagesize");
+
+	for (i = optind; i < argc; i++)
+		drop_file(&d, argv[i]);
+
+	if (argc - optind > 1)
+		printf("Total: %llu pages before, %llu after, %.1f MB "
+		    "removed\n", d.before, d.after, (double) (d.before
+		    > d.after ? d.before - d.after : 0) * (double) d.r.pagesize
+		    / 1e6);
 	return (0);
 }
 
+
+/*
+ * Pages of [start:end) in the pagecache, with cachestat() if available (then
+ * returns 1 & the other counts are in 'rs'), else mincore().  Returns -1
+ * with errno set on failure.
+ */
+int
+count_pages(struct drop *d, int fd, off_t start, off_t end,
+    unsigned long long *pim, struct residency_stat *rs)
+{
+	if (d->cachestat) {
+		if (residency_stat(fd, start, end - start, rs) == 0) {
+			*pim = rs->cached;
+			return (1);
+		}
+		if (errno != ENOSYS && errno != EOPNOTSUPP)
+			return (-1);
+		d->cachestat = 0;
+	}
+
+	return (residency_count_range(&d->r, fd, start, end, pim));
+}
+
+
+/* Writes the dirty pages of the range & waits for them */
+int
+sync_range(int fd, off_t start, off_t end)
+{
+#ifdef __linux__
+	return (sync_file_range(fd, start, end - start,
+	    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+	    | SYNC_FILE_RANGE_WAIT_AFTER));
+#else
+	(void) start;
+	(void) end;
+
+	return (fdatasync(fd));
+#endif /* __linux__ */
+}
+
+
+void
+drop_file(struct drop *d, const char *path)
+{
+	struct residency_stat	 rs;
+	struct timespec		 ts;
+	struct stat		 st;
+	unsigned long long	 before, after;
+	off_t			 start, end;
+	int			 fd, pass, rc, extra;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		warning(errno, "Unable to open '%s'", path);
+		return;
+	}
+	if (fstat(fd, &st) == -1) {
+		warning(errno, "Unable to stat '%s'", path);
+		goto done;
+	}
+	if (st.st_size == 0 || d->offset >= (unsigned long long) st.st_size)
+		goto done;
+	start = (off_t) d->offset;
+	end = d->length > 0 && d->length < (unsigned long long) st.st_size
+	    - d->offset ? (off_t) (d->offset + d->length) : st.st_size;
+
+	extra = count_pages(d, fd, start, end, &before, &rs);
+	if (extra == -1) {
+		warning(errno, "Unable to get core info for '%s'", path);
+		goto done;
+	}
+
+	after = before;
+	for (pass = 0; pass <= d->retries && after > 0; pass++) {
+		if (pass > 0) {
+			/* Some time for whatever kept the pages */
+			ts.tv_sec = 0;
+			ts.tv_nsec = 100000000;
+			nanosleep(&ts, NULL);
+		}
+		if (d->sync && sync_range(fd, start, end) == -1)
+			warning(errno, "Unable to write the dirty pages of "
+			    "'%s'", path);
+		rc = posix_fadvise(fd, start, end - start,
+		    POSIX_FADV_DONTNEED);
+		if (rc != 0) {
+			warning(rc, "Unable to give cache hint for '%s'",
+			    path);
+			goto done;
+		}
+		extra = count_pages(d, fd, start, end, &after, &rs);
+		if (extra == -1) {
+			warning(errno, "Unable to get core info for '%s'",
+			    path);
+			goto done;
+		}
+	}
+
+	printf("'%s': %llu pages before, %llu after, %.1f MB removed", path,
+	    before, after, (double) (before > after ? before - after : 0)
+	    * (double) d->r.pagesize / 1e6);
+	if (after > 0 && extra == 1)
+		printf(" (%llu dirty, %llu under writeback left)", rs.dirty,
+		    rs.writeback);
+	if (pass > 1)
+		printf(", %d passes", pass);
+	printf("\n");
+	d->before += before;
+	d->after += after;
+
+done:
+	if (close(fd) == -1)
+		warning(errno, "Problem closing '%s'", path);
+}
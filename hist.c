@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Log-linear histogram: values below 2 * HIST_SUB_COUNT have their own
+ * bucket, above that each [2^n, 2^(n+1)) range is split in HIST_SUB_COUNT
+ * equal sub-buckets.  Recording is O(1) and the memory footprint is fixed.
+ */
+
+#include <string.h>
+
+#include "hist.h"
+
+static unsigned hist_index(uint64_t);
+static uint64_t hist_lower(unsigned);
+static unsigned msb64(uint64_t);
+
+
+unsigned
+msb64(uint64_t v)
+{
+	unsigned n = 0;
+
+#if defined(__GNUC__)
+	n = 63 - (unsigned) __builtin_clzll((unsigned long long) v);
+#else
+	while (v >>= 1)
+		n++;
+#endif
+	return (n);
+}
+
+
+unsigned
+hist_index(uint64_t v)
+{
+	unsigned e;
+
+	if (v < 2 * HIST_SUB_COUNT)
+		return ((unsigned) v);
+
+	e = msb64(v) - HIST_SUB_BITS;
+
+	return (e * HIST_SUB_COUNT + (unsigned) (v >> e));
+}
+
+
+/* Smallest value recorded in bucket 'idx' */
+uint64_t
+hist_lower(unsigned idx)
+{
+	unsigned e;
+
+	if (idx < 2 * HIST_SUB_COUNT)
+		return ((uint64_t) idx);
+
+	e = idx / HIST_SUB_COUNT - 1;
+
+	return ((uint64_t) (idx % HIST_SUB_COUNT + HIST_SUB_COUNT) << e);
+}
+
+
+void
+hist_init(struct hist *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+
+void
+hist_add(struct hist *h, uint64_t v)
+{
+	h->buckets[hist_index(v)]++;
+	h->count++;
+	h->sum += v;
+	if (v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+}
+
+
+void
+hist_merge(struct hist *dst, const struct hist *src)
+{
+	unsigned i;
+
+	if (src->count == 0)
+		return;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+
+/*
+ * Returns the value below which 'pct' percent of the recorded values fall
+ * (the middle of the matching bucket, clamped to the recorded extrema).
+ */
+uint64_t
+hist_percentile(const struct hist *h, double pct)
+{
+	uint64_t	 rank, seen = 0, lo, hi, v;
+	unsigned	 i;
+
+	if (h->count == 0)
+		return (0);
+
+	rank = (uint64_t) (pct / 100.0 * (double) h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > h->count)
+		rank = h->count;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+	if (i == HIST_BUCKETS)
+		return (h->max);
+
+	lo = hist_lower(i);
+	hi = (i + 1 < HIST_BUCKETS) ? hist_lower(i + 1) - 1 : UINT64_MAX;
+	v = lo + (hi - lo) / 2;
+
+	if (v < h->min)
+		v = h->min;
+	if (v > h->max)
+		v = h->max;
+
+	return (v);
+}
+
+
+double
+hist_mean(const struct hist *h)
+{
+	if (h->count == 0)
+		return (0.0);
+
+	return ((double) h->sum / (double) h->count);
+}
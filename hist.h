@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Log-linear (HDR-style) histogram of 64 bits values.
+ */
+
+#ifndef __HIST_H__
+#define __HIST_H__
+
+#include <stdint.h>
+
+/*
+ * Each power of two range is split in 2^HIST_SUB_BITS linear sub-buckets,
+ * values are recorded with a relative precision better than 1/2^HIST_SUB_BITS.
+ */
+#define HIST_SUB_BITS	5
+#define HIST_SUB_COUNT	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS	((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+struct hist {
+	uint64_t	count;
+	uint64_t	min;
+	uint64_t	max;
+	uint64_t	sum;
+	uint64_t	buckets[HIST_BUCKETS];
+};
+
+extern void hist_init(struct hist *);
+extern void hist_add(struct hist *, uint64_t);
+extern void hist_merge(struct hist *, const struct hist *);
+extern uint64_t hist_percentile(const struct hist *, double);
+extern double hist_mean(const struct hist *);
+
+#endif /* __HIST_H__ */
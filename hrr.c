@@ -17,140 +17,612 @@
  * instructions (readahead()) to the pagecache.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE	/* O_DIRECT, readahead(), splice() */
+#endif /* __linux__ */
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif /* __linux__ */
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/vfs.h>
 
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "cpustat.h"
+#include "dataset.h"
 #include "errwarn.h"
+#include "hist.h"
+#include "pattern.h"
+#include "punt.h"
+#include "rng.h"
+#include "trace.h"
+#include "uring.h"
+#include "util.h"
 
 const char	progname[] = "hrr";
 const off_t	default_alignment = 512;
 const size_t	default_minbsize = 512;
 const size_t	default_maxbsize = 32768;
+const int	max_threads = 1024;
+const unsigned	default_qdepth = 32;
+const unsigned	max_qdepth = 4096;
+const size_t	default_maxopen = 1024;
+const int	default_punters = 4;
+
+/* Long options without a short equivalent */
+enum {
+	OPT_RECORD = 256,
+	OPT_REPLAY,
+	OPT_ASAP
+};
+
+/* I/O engines, in the same order as engine_names[] */
+enum engine {
+	ENGINE_READ,		/* lseek() & read() */
+	ENGINE_PREAD,		/* pread() */
+	ENGINE_URING,		/* io_uring, up to 'qdepth' reads in flight */
+	ENGINE_MMAP,		/* memcpy() from a mapping of the window */
+	ENGINE_MMAP_TOUCH,	/* one byte per page from the mapping */
+	ENGINE_NOWAIT,		/* preadv2(RWF_NOWAIT), else punted to a pool */
+	ENGINE_SENDFILE,	/* sendfile() to /dev/null */
+	ENGINE_SPLICE,		/* splice() to a pipe drained to /dev/null */
+	ENGINE_COUNT
+};
+const char	*engine_names[ENGINE_COUNT] = {
+	"read", "pread", "uring", "mmap", "mmap-touch", "nowait", "sendfile",
+	"splice"
+};
+#define IS_MMAP_ENGINE(e)	((e) == ENGINE_MMAP || (e) == ENGINE_MMAP_TOUCH)
+#define IS_ZCOPY_ENGINE(e)	((e) == ENGINE_SENDFILE || (e) == ENGINE_SPLICE)
+
+/*
+ * Operations, with separate stats, hits & misses are the reads found (or
+ * not) in the pagecache when classified (-c), inline & punted the reads
+ * served without blocking (or not) by the 'nowait' engine, for which the
+ * time spent by the punted reads waiting for a thread of the pool is
+ * accounted as 'queued'.
+ */
+enum op {
+	OP_READ,
+	OP_WRITE,
+	OP_HIT,
+	OP_MISS,
+	OP_INLINE,
+	OP_PUNTED,
+	OP_QUEUED,
+	OP_COUNT
+};
+const char	*op_names[OP_COUNT] = {
+	"reads", "writes", "hits", "misses", "inline", "punted", "queued"
+};
+
+/* Durability policies for the writes, in the same order as sync_names[] */
+enum sync_policy {
+	SYNC_NONE,		/* left to the kernel writeback */
+	SYNC_FDATASYNC,		/* fdatasync() every 'sync_every' writes */
+	SYNC_RANGE,		/* sync_file_range() write-behind */
+	SYNC_DSYNC,		/* O_DSYNC */
+	SYNC_COUNT
+};
+const char	*sync_names[SYNC_COUNT] = {
+	"none", "fdatasync", "range", "dsync"
+};
+
+#if defined(__linux__) && !defined(MADV_COLLAPSE)
+#define MADV_COLLAPSE	25
+#endif
+
+/* madvise() advices for the mmap engines */
+struct advice {
+	const char	*name;
+	int		 advice;
+};
+const struct advice advices[] = {
+	{ "normal",	MADV_NORMAL },
+	{ "random",	MADV_RANDOM },
+	{ "sequential",	MADV_SEQUENTIAL },
+	{ "willneed",	MADV_WILLNEED },
+#ifdef MADV_HUGEPAGE
+	{ "hugepage",	MADV_HUGEPAGE },
+#endif /* MADV_HUGEPAGE */
+#ifdef MADV_COLLAPSE
+	{ "collapse",	MADV_COLLAPSE },
+#endif /* MADV_COLLAPSE */
+	{ NULL,		0 }
+};
+
+/* Interval report: counters & latency percentiles (ns) per operation */
+struct sample {
+	double			 t;		/* s, end of the interval */
+	double			 length;	/* s */
+	unsigned long		 nops[OP_COUNT];
+	unsigned long long	 nbytes[OP_COUNT];
+	uint64_t		 p50[OP_COUNT];
+	uint64_t		 p99[OP_COUNT];
+};
+
+struct series {
+	struct sample		*samples;
+	size_t			 n;
+	size_t			 alloc;
+};
+
+/*
+ * Parameters shared (read-only once the threads are started, except for the
+ * atomic 'nrunning') by all the reader threads.
+ */
+struct job {
+	struct dataset		*ds;
+	size_t			 maxopen;	/* per thread */
+	size_t			 minbsize;
+	size_t			 maxbsize;
+	off_t			 alignment;
+	size_t			 toread;
+	uint64_t		 seed;
+	int			 pregen;	/* reads drawn beforehand */
+	int			 nthreads;
+	enum engine		 engine;
+	unsigned		 qdepth;
+	struct pattern		 pattern;
+	int			 direct;	/* O_DIRECT */
+	size_t			 dio_align;	/* O_DIRECT size alignment */
+	const struct advice	*advice;	/* mmap engines */
+	struct trace		*record;	/* reads issued, if recorded */
+	uint32_t		*trace_ids;	/* file index -> trace path */
+	const struct trace	*replay;	/* reads to issue, if replayed */
+	int			 asap;		/* replay ignoring the times */
+	int			 wratio;	/* % of writes */
+	int			 classify;	/* reads hits & misses */
+	int			 npunters;	/* 'nowait' engine pool */
+	struct punt		*punt;
+	enum sync_policy	 sync;
+	unsigned		 sync_every;	/* SYNC_FDATASYNC */
+	uint64_t		 duration;	/* ns, 0: until 'toread' */
+	double			 rate;		/* 0: unlimited */
+	int			 rate_bytes;	/* 'rate' in bytes/s, not IOPS */
+	uint64_t		 interval;	/* ns, 0: no interval reports */
+	struct series		*series;
+	int			 json;
+	int			 nrunning;	/* reader threads */
+	uint64_t		 t_base;	/* ns, start of the run */
+	pthread_barrier_t	 start;
+};
+
+/* Counters & latency histogram (in nanoseconds) */
+struct stats {
+	unsigned long		 nops;
+	unsigned long long	 nbytes;
+	struct hist		 lat;
+};
+
+/*
+ * A read (or write): file (index in the dataset), offset in the file, size &
+ * when it is to be issued (replay only, 0 for immediately)
+ */
+struct req {
+	enum op			 op;
+	enum op			 cls;		/* hit, miss or unknown (read) */
+	size_t			 file;
+	off_t			 offset;
+	size_t			 bsize;
+	uint64_t		 due;		/* ns */
+};
+
+/*
+ * Per-thread state: each reader has its own descriptors (lseek() & read()
+ * would otherwise race) & mappings, buffer (one 'maxbsize' slot per possible
+ * read in flight), ring, PRNG state & share of the amount of data to read.
+ */
+struct worker {
+	pthread_t		 tid;
+	struct job		*job;
+	int			 id;
+	struct fdcache		 fc;
+	unsigned char		*buffer;
+	struct uring		 ring;
+	struct punt_cq		 cq;		/* punted reads completions */
+	int			 sink;		/* zero-copy engines */
+	int			 pipe[2];	/* 'splice' engine */
+	struct rng		 rng;
+	struct req		*sched;		/* pregenerated reads */
+	size_t			 nsched;
+	size_t			 snext;
+	off_t			 cursor;	/* for sequential patterns */
+	unsigned char		 touched;	/* for the mmap-touch engine */
+#ifdef __linux__
+	unsigned char		*vec;		/* for mincore() */
+#else
+	char			*vec;
+#endif
+	size_t			 toread;
+	size_t			 rnext;		/* next replayed record */
+	struct trace		 rec;		/* recorded reads */
+	struct stats		 st[OP_COUNT];
+	unsigned long		 nwrites;	/* for the sync policy */
+	unsigned long		 nissued;	/* for the rate limit */
+	unsigned long long	 bissued;
+	uint64_t		 phase;		/* ns, rate limit schedule */
+	pthread_mutex_t		 lock;		/* for 'ist' */
+	struct stats		 ist[OP_COUNT];	/* current interval */
+	uint64_t		 t_start;	/* ns */
+	uint64_t		 t_end;		/* ns */
+	struct cpustat		 cpu;		/* used by the read loop */
+};
 
 void usage(FILE *);
+void run(struct job *, struct worker *, struct stats *, double *);
+void report(const struct job *, const struct worker *, const struct stats *,
+    double);
+void parse_sync(const char *, enum sync_policy *, unsigned *);
+void parse_rate(const char *, double *, int *);
+size_t roundup_to(size_t, size_t);
 int give_posix_hints(int, off_t, size_t);
 int prefetch(int, off_t, size_t);
-#ifndef GLIBC_IS_NO_LONGER_BRAINDEAD
-ssize_t readahead(int fd, off_t *offset, size_t count);
-#endif /* GLIBC_IS_NO_LONGER_BRAINDEAD */
+enum engine parse_engine(const char *);
+const struct advice *parse_advice(const char *);
+struct ofile *get_file(struct worker *, size_t);
+ssize_t map_read(struct worker *, const struct ofile *, off_t, size_t);
+ssize_t zcopy_read(struct worker *, const struct ofile *, off_t, size_t);
+int next_read(struct worker *, size_t, struct req *);
+void draw_read(struct worker *, size_t, struct req *);
+void pregenerate(struct worker *);
+void wait_until(uint64_t);
+void setup_replay(struct trace *, struct dataset *, const char *);
+void sync_write(struct worker *, int, const struct req *);
+void *reader(void *);
+void read_sync(struct worker *);
+void read_uring(struct worker *);
+void read_nowait(struct worker *);
+void account(struct stats *, ssize_t, uint64_t);
+void account_op(struct worker *, enum op, ssize_t, uint64_t);
+int op_shown(const struct job *, int);
+enum op classify(struct worker *, const struct ofile *, const struct req *);
+void pace(struct worker *, struct req *);
+void take_sample(struct job *, struct worker *, uint64_t, uint64_t);
+void print_sample(const struct job *, const struct sample *);
+void print_text(const char *, enum op, const struct stats *, double);
+void print_cpu(const char *, const struct cpustat *, unsigned long long);
+void cpu_total(const struct job *, const struct worker *, struct cpustat *);
+void print_json_cpu(const struct cpustat *, unsigned long long);
+void print_json_stats(const struct stats *, double);
+void print_json_lat(const struct hist *);
+void print_json(const struct job *, const struct worker *,
+    const struct stats *, double);
+void print_compare(enum op, const struct stats *, double,
+    const struct stats *, double);
+void print_compare_cpu(const struct cpustat *, unsigned long long,
+    const struct cpustat *, unsigned long long);
 
 void usage(FILE *fp)
 {
 	fprintf(fp,
-"\nReads data randomly from a file.\n"
+"\nReads data randomly from a file or a set of files.\n"
 "\nUsage:\n"
-"%s [-b minbsize] [-B maxbsize] [-H] [-L length] [-O startoffset] [-P] [-R] "
-"[-S size] [-Z alignment] filename\n"
+"%s [-A pattern] [-b minbsize] [-B maxbsize] [-C] [-c] [-D] [-E engine]\n"
+"    [-F filelist] [-G] [-H] [-i interval] [-J] [-j threads] [-L length]\n"
+"    [-M advice] [-N maxopen] [-O startoffset] [-P] [-p threads] [-Q depth]\n"
+"    [-R] [-r rate] [-S size] [-s seed] [-T duration] [-w ratio] [-Y policy]\n"
+"    [-Z alignment]\n"
+"    [--json] [--record trace] [file|directory ...]\n"
+"%s [options] --replay trace [--asap]\n"
 "\nWhere:\n"
+" -A pattern: access pattern, one of:\n"
+"    uniform       uniformly random offsets (the default),\n"
+"    seq, rev      sequential reads, forwards or backwards,\n"
+"    stride:N      reads starting every N bytes,\n"
+"    zipf:theta    the window is split in maxbsize records which popularity\n"
+"                  follows a Zipf law (0 < theta < 1, e.g. 0.99),\n"
+"    hotspot:X:Y   X%% of the reads hit the first Y%% of the window.\n"
+"    Sequential patterns wrap around, each thread starts at a different\n"
+"    place in the window.\n"
 " -b minbsize: set the minimum default read block size to minbsize.\n"
 "    Default is: %lu bytes.\n"
 " -B maxbsize: set the maximum default read block size to maxbsize.\n"
 "    Default is: %lu bytes.\n"
+" -C compares buffered & direct I/O: the same reads are done twice, first\n"
+"    through the pagecache, then with O_DIRECT, results are shown side by\n"
+"    side.\n"
+" -c classifies the reads as pagecache hits (all the pages read are in the\n"
+"    pagecache just before the read) or misses, with mincore() on a mapping\n"
+"    of the files.  Hits & misses are reported separately (also per interval\n"
+"    with -i) with the hit ratio.\n"
+" -D opens the file with O_DIRECT to bypass the pagecache.  Block sizes &\n"
+"    alignment are rounded up to the filesystem block size.\n"
+" -E engine: I/O engine, one of 'read' (lseek & read, the default), 'pread',\n"
+"    'uring' (io_uring, falls back to 'pread' when unavailable), 'mmap'\n"
+"    (memcpy from a shared mapping of the window), 'mmap-touch' (reads one\n"
+"    byte per page from the mapping) or 'nowait' (tries to read from the\n"
+"    pagecache only with preadv2 & RWF_NOWAIT, reads which would block are\n"
+"    handed to a pool of threads, see -p), 'sendfile' (to /dev/null) or\n"
+"    'splice' (through a pipe, to /dev/null): the zero-copy engines do not\n"
+"    copy the data to user space.\n"
+" -F filelist: read the names of the files (or directories) to read from\n"
+"    filelist, one per line ('-' for the standard input).\n"
+" -G draws all the reads (offsets & sizes) before starting, timed runs without\n"
+"    -S cycle through the reads of the default size.\n"
 " -H gives a hint to the filesystem (with posix_fadvise)\n"
+" -i interval: report IOPS, throughput & latency every 'interval' seconds\n"
+"    (e.g. 1 or 0.1) while running, to follow the cache warm up.\n"
+" -J, --json: print the results (throughput, IOPS & latency percentiles) as\n"
+"    a JSON document instead of text.\n"
+" -j threads: number of concurrent reader threads, each with its own\n"
+"    descriptor & buffer, the amount of data to read is split between them.\n"
+"    Default is 1.\n"
 " -L length: max offset to read from, relative to startoffset, default is\n"
 "    (file size - offset).\n"
+" -M advice: madvise() advice for the mapping used by the mmap engines, one\n"
+"    of 'normal' (the default), 'random', 'sequential', 'willneed', 'hugepage'\n"
+"    or 'collapse' (the last two where supported).\n"
+" -N maxopen: max. number of files kept open (& mapped), split between\n"
+"    the threads, default is %lu.  Files are opened before starting to read\n"
+"    & as needed afterwards (outside of the timed part of the reads).\n",
+	    progname, progname, (unsigned long) default_minbsize,
+	    (unsigned long) default_maxbsize,
+	    (unsigned long) default_maxopen);
+	fprintf(fp,
 " -O startoffset: do I/Os in the file from that offset on, default is 0\n"
 "    start of file.\n"
-" -P Use pread instead of lseek & read.\n"
+" -P Use pread instead of lseek & read (same as '-E pread').\n"
+" -p threads: number of threads of the pool doing the blocking reads for\n"
+"    the 'nowait' engine, default is %d.\n"
+" -Q depth: number of reads kept in flight by each thread with the 'uring'\n"
+"    engine (or punted with the 'nowait' engine), default is %u.\n"
 " -R instructs the pagecache to prefetch the file target zone before reading.\n"
-" -S size: amount of data to read, default is 1/8 of the file size.\n"
+" -r rate: target rate, in IOPS ('5000' or '5000iops') or MB/s ('200MB'),\n"
+"    split between the threads.  I/Os are issued on a fixed schedule, late\n"
+"    I/Os are issued at once without shifting the following ones.\n"
+" -S size: amount of data to read, default is 1/8 of the file(s) size or\n"
+"    unlimited with -T.\n"
+" -s seed: seed of the offsets & sizes generator, to get the same reads from\n"
+"    one run to the next (the seed used is always printed).\n"
+" -T duration: stop after that many seconds (or when 'size' is read).\n"
+" -w ratio: percentage of writes (e.g. 30 or 70/30 for reads/writes), the\n"
+"    files are then opened read-write & their content is overwritten (they\n"
+"    are never extended).  Reads & writes latencies are reported separately.\n"
+" -Y policy: durability policy for the writes, one of 'none' (the default),\n"
+"    'fdatasync[:N]' (fdatasync() every N writes, default 1), 'range'\n"
+"    (sync_file_range() write-behind after every write) or 'dsync' (O_DSYNC).\n"
+"    The time to sync is part of the latency of the write triggering it.\n"
 " -Z alignment: align read block boundaries on alignment (bytes).\n"
 "    For pure random reads use 1, 512 for sector alignment, 4096 for generic\n"
 "    FS block alignment, etc.  Default is sector alignment.\n"
+" --record trace: write every read issued (file, offset, size & time) to\n"
+"    trace, in a compact binary format.\n"
+" --replay trace: issue the reads of a trace, recorded or in text format\n"
+"    ('-' for the standard input), one '[time,]path,offset,size' per line\n"
+"    (time in seconds, a read without one follows the previous read), at\n"
+"    their original times or as fast as possible (--asap).  The files are\n"
+"    those of the trace, the reads are dealt to the threads in turn, -S, -O,\n"
+"    -L & the access pattern are ignored.\n"
 "\nFor cache hints and instructions, the prefetched/hinted part of the file\n"
 "is the zone between 'startoffset' & 'startoffset+length' (these values can\n"
-"be specified with -O & -L)\n",
-	    progname, (unsigned long) default_minbsize,
-	    (unsigned long) default_maxbsize);
-
+"be specified with -O & -L)\n"
+"\nWith several files (given on the command line, found recursively in\n"
+"directories or listed in filelist), -O & -L apply to every file & the files\n"
+"windows are read as a single dataset: random offsets select the files\n"
+"proportionally to their size, sequential patterns go through the files in\n"
+"order.  Hints are given for every file.\n"
+"\nThe latency of every read is recorded, for the 'uring' engine it is the\n"
+"time from submission to completion.\n",
+	    default_punters, default_qdepth);
 	exit(1);
 }
 
 
 int main(int argc, char *argv[])
 {
+	static const struct option longopts[] = {
+		{ "json", no_argument, NULL, 'J' },
+		{ "record", required_argument, NULL, OPT_RECORD },
+		{ "replay", required_argument, NULL, OPT_REPLAY },
+		{ "asap", no_argument, NULL, OPT_ASAP },
+		{ NULL, 0, NULL, 0 }
+	};
 	struct timeval	 tv;
-	struct stat	 st;
-	unsigned char	*buffer = NULL;
-	char		*filename = NULL;
+	struct rlimit	 rl;
+	struct cpustat	 cpu, dcpu;
+	struct stats	 total[OP_COUNT], dtotal[OP_COUNT];
+	struct series	 series, dseries;
+	struct statfs	 sfs;
+	struct dataset	 ds;
+	struct trace	 record, replay;
+	struct job	 job;
+	struct worker	*workers = NULL, *dworkers = NULL;
+	char		 what[64], amount[64];
+	const char	*filename = NULL, *opt_filelist = NULL;
+	const char	*opt_record = NULL, *opt_replay = NULL;
+	const char	*opt_wratio = NULL;
+	char		*end = NULL;
 	off_t		 offset = 0, start_offset;
 	off_t		 alignment = default_alignment;
-	size_t		 toread = 0, length = 0, bsize = 0;
+	size_t		 toread = 0, length = 0, wlength = 0, i;
+	size_t		 maxopen = default_maxopen;
 	size_t		 minbsize = default_minbsize;
 	size_t		 maxbsize = default_maxbsize;;
-	ssize_t		 nr = 0;
-	unsigned int	 seed = 0;
-	int		 fd = 1;
+	double		 elapsed, delapsed;
+	double		 opt_duration = 0.0, opt_interval = 0.0, rate = 0.0;
+	uint64_t	 seed = 0;
+	int		 fd = 1, nthreads = 1, a, tid;
 	int		 ch = -1;
 	long long int	 opt_size = 0, opt_maxbsize = 0, opt_minbsize = 0;
 	long long int	 opt_offset = 0, opt_length = 0, opt_alignment = 0;
-	int		 opt_pread = 0, opt_give_hints = 0, opt_prefetch = 0;
+	long long int	 opt_threads = 0, opt_qdepth = 0, opt_maxopen = 0;
+	int		 opt_give_hints = 0, opt_prefetch = 0, opt_json = 0;
+	int		 opt_direct = 0, opt_compare = 0, opt_asap = 0;
+	int		 opt_classify = 0, npunters = default_punters;
+	int		 opt_seed = 0, opt_pregen = 0;
+	enum engine	 engine = ENGINE_READ;
+	unsigned	 qdepth = default_qdepth;
+	const char	*opt_pattern = "uniform";
+	const struct advice *advice = &advices[0];
+	enum sync_policy sync = SYNC_NONE;
+	unsigned	 sync_every = 1;
+	int		 wratio = 0, rate_bytes = 0;
 
-	while ((ch = getopt(argc, argv, ":b:B:HL:O:PRS:Z:")) != -1) {
+	while ((ch = getopt_long(argc, argv,
+	    ":A:b:B:CcDE:F:GHi:Jj:L:M:N:O:Pp:Q:Rr:S:s:T:w:Y:Z:",
+	    longopts, NULL)) != -1) {
 		switch (ch) {
+		case 'A':
+			opt_pattern = optarg;
+			break;
 		case 'b':
 			opt_minbsize = atoll(optarg);
 			break;
 		case 'B':
 			opt_maxbsize = atoll(optarg);
 			break;
+		case 'C':
+			opt_compare = 1;
+			break;
+		case 'c':
+			opt_classify = 1;
+			break;
+		case 'D':
+			opt_direct = 1;
+			break;
+		case 'E':
+			engine = parse_engine(optarg);
+			break;
+		case 'F':
+			opt_filelist = optarg;
+			break;
+		case 'G':
+			opt_pregen = 1;
+			break;
 		case 'H':
 			opt_give_hints = 1;
 			break;
+		case 'i':
+			opt_interval = atof(optarg);
+			if (opt_interval <= 0.0)
+				error(1, -1, "Invalid interval: '%s'", optarg);
+			break;
+		case 'J':
+			opt_json = 1;
+			break;
+		case 'j':
+			opt_threads = atoll(optarg);
+			break;
 		case 'L':
 			opt_length = atoll(optarg);
 			break;
+		case 'M':
+			advice = parse_advice(optarg);
+			break;
+		case 'N':
+			opt_maxopen = atoll(optarg);
+			break;
 		case 'O':
 			opt_offset = atoll(optarg);
 			break;
 		case 'P':
-			opt_pread = 1;
+			engine = ENGINE_PREAD;
+			break;
+		case 'p':
+			npunters = atoi(optarg);
+			if (npunters <= 0 || npunters > max_threads)
+				error(1, -1, "Invalid number of threads: '%s' "
+				    "(max. %d)", optarg, max_threads);
+			break;
+		case 'Q':
+			opt_qdepth = atoll(optarg);
 			break;
 		case 'R':
 			opt_prefetch = 1;
 			break;
+		case 'r':
+			parse_rate(optarg, &rate, &rate_bytes);
+			break;
 		case 'S':
 			opt_size = atoll(optarg);
 			break;
+		case 's':
+			errno = 0;
+			seed = (uint64_t) strtoull(optarg, &end, 0);
+			if (errno != 0 || end == optarg || *end != '\0')
+				error(1, -1, "Invalid seed: '%s'", optarg);
+			opt_seed = 1;
+			break;
+		case 'T':
+			opt_duration = atof(optarg);
+			if (opt_duration <= 0.0)
+				error(1, -1, "Invalid duration: '%s'", optarg);
+			break;
+		case 'w':
+			opt_wratio = optarg;
+			break;
+		case 'Y':
+			parse_sync(optarg, &sync, &sync_every);
+			break;
 		case 'Z':
 			opt_alignment = atoll(optarg);
 			break;
+		case OPT_RECORD:
+			opt_record = optarg;
+			break;
+		case OPT_REPLAY:
+			opt_replay = optarg;
+			break;
+		case OPT_ASAP:
+			opt_asap = 1;
+			break;
 		default:
 			usage(stderr);
 			break;
 		}
 	}
-	if (optind != (argc - 1)) {
+	if (optind == argc && opt_filelist == NULL && opt_replay == NULL) {
 		warning(-1, "Filename required");
 		usage(stderr);
 	}
-	filename = argv[optind];
-
-	memset(&st, 0, sizeof(st));
-	if (lstat(filename, &st) == -1)
-		error(1, errno, "Unable to stat '%s'", argv[1]);
 
-	if (!S_ISREG(st.st_mode))
-		error(1, -1, "'%s' is not a regular file", argv[1]);
+	dataset_init(&ds);
+	trace_init(&replay);
+	if (opt_replay != NULL) {
+		if (optind < argc || opt_filelist != NULL)
+			warning(-1, "Replaying '%s', the files to read are "
+			    "those of the trace", opt_replay);
+		if (opt_size || opt_offset || opt_length)
+			warning(-1, "Replaying '%s', -S, -O & -L are ignored",
+			    opt_replay);
+		opt_size = opt_offset = opt_length = 0;
+		optind = argc;
+		opt_filelist = NULL;
+		setup_replay(&replay, &ds, opt_replay);
+	} else if (opt_asap)
+		warning(-1, "--asap is only meaningful with --replay");
 
-	if (opt_size) {
-		if (opt_size > 0)
-			toread = (size_t) opt_size;
-		else {
-			close(fd);
-			error(1, -1, "Invalid block size: %d", opt_size);
+	for (a = optind; a < argc; a++) {
+		if (dataset_add(&ds, argv[a]) == -1) {
+			if (errno == EINVAL)
+				error(1, -1, "'%s' is not a regular file or a "
+				    "directory", argv[a]);
+			error(1, errno, "Unable to add '%s'", argv[a]);
 		}
-	} else
-		toread = (size_t) st.st_size / 8;
+	}
+	if (opt_filelist != NULL && dataset_add_list(&ds, opt_filelist) == -1)
+		error(1, errno, "Unable to read file list '%s'", opt_filelist);
+	if (ds.nfiles == 0)
+		error(1, -1, "No file to read from");
+	filename = ds.files[0].path;
 
 	if (opt_maxbsize) {
 		if (opt_maxbsize > 0)
@@ -170,6 +642,7 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	/* Out of range windows are only errors for a single file */
 	if (opt_offset) {
 		if (opt_offset > 0)
 			start_offset = (off_t) opt_offset;
@@ -177,10 +650,10 @@ int main(int argc, char *argv[])
 			close(fd);
 			error(1, -1, "Invalid start offset: %d", opt_offset);
 		}
-		if (start_offset > st.st_size) {
+		if (ds.nfiles == 1 && start_offset > ds.files[0].size) {
 			close(fd);
 			error(1, -1, "Start offset beyond '%s' size: %lu",
-			    (unsigned long) start_offset);
+			    filename, (unsigned long) start_offset);
 		}
 	} else
 		start_offset = (off_t) 0U;
@@ -192,13 +665,50 @@ int main(int argc, char *argv[])
 			close(fd);
 			error(1, -1, "Invalid initial length: %d", opt_length);
 		}
-		if ((start_offset + (off_t) length) > st.st_size) {
+		if (ds.nfiles == 1
+		    && (start_offset + (off_t) length) > ds.files[0].size) {
 			close(fd);
 			error(1, -1, "Target zone beyond '%s' size: %lu",
-			    (unsigned long) start_offset + length);
+			    filename, (unsigned long) start_offset + length);
 		}
-	} else
-		length = (size_t) st.st_size - (size_t) start_offset;
+	}
+
+	if (opt_replay == NULL)
+		dataset_window(&ds, start_offset, (off_t) length);
+	if (ds.nfiles == 0)
+		error(1, -1, "Nothing to read in the target zone");
+	filename = ds.files[0].path;
+	length = (size_t) ds.length;
+	for (i = 0; i < ds.nfiles; i++)
+		if ((size_t) ds.files[i].length > wlength)
+			wlength = (size_t) ds.files[i].length;
+
+	if (opt_size) {
+		if (opt_size > 0)
+			toread = (size_t) opt_size;
+		else {
+			close(fd);
+			error(1, -1, "Invalid block size: %d", opt_size);
+		}
+	} else if (opt_duration > 0.0)
+		toread = SIZE_MAX;
+	else
+		toread = length / 8;
+
+	/* The reads are those of the trace, whatever their size */
+	if (opt_replay != NULL) {
+		toread = 0;
+		minbsize = maxbsize = 0;
+		for (i = 0; i < replay.nrecs; i++) {
+			size_t size = replay.recs[i].size;
+
+			toread += size;
+			if (minbsize == 0 || size < minbsize)
+				minbsize = size;
+			if (size > maxbsize)
+				maxbsize = size;
+		}
+	}
 
 	if (opt_alignment) {
 		if (opt_alignment > 0)
@@ -210,104 +720,1912 @@ int main(int argc, char *argv[])
 	} else
 		alignment = default_alignment;
 
-	fd = open(filename, O_RDONLY);
-	if (fd == -1)
-		error(1, errno, "Unable to open '%s'", filename);
+	if (opt_threads) {
+		if (opt_threads > 0 && opt_threads <= max_threads)
+			nthreads = (int) opt_threads;
+		else
+			error(1, -1, "Invalid number of threads: %lld (max. "
+			    "%d)", opt_threads, max_threads);
+	}
+
+	if (opt_qdepth) {
+		if (opt_qdepth > 0 && opt_qdepth <= (long long int) max_qdepth)
+			qdepth = (unsigned) opt_qdepth;
+		else
+			error(1, -1, "Invalid queue depth: %lld (max. %u)",
+			    opt_qdepth, max_qdepth);
+	}
+	if (engine != ENGINE_URING && engine != ENGINE_NOWAIT)
+		qdepth = 1;
+
+	if (IS_MMAP_ENGINE(engine) && (opt_direct || opt_compare))
+		error(1, -1, "O_DIRECT is not supported by the mmap engines");
 
-	if (opt_give_hints) {
-		int hrc = give_posix_hints(fd, start_offset, length);
+	/* Either a write percentage or a reads/writes ratio */
+	if (opt_wratio != NULL) {
+		char		*ep;
+		long int	 rd, wr;
 
-		if (hrc == -1)
-			warning(errno, "Unable to give cache hints for '%s'",
-			    filename);
+		wr = strtol(opt_wratio, &ep, 10);
+		if (*ep == '/') {
+			rd = wr;
+			wr = strtol(ep + 1, &ep, 10);
+			if (rd >= 0 && wr >= 0 && rd + wr > 0)
+				wr = wr * 100 / (rd + wr);
+			else
+				wr = -1;
+		}
+		if (*ep != '\0' || wr < 0 || wr > 100)
+			error(1, -1, "Invalid write ratio: '%s'", opt_wratio);
+		wratio = (int) wr;
+	}
+	if (wratio > 0 && IS_MMAP_ENGINE(engine))
+		error(1, -1, "Writes are not supported by the mmap engines");
+	if (wratio > 0 && engine == ENGINE_NOWAIT)
+		error(1, -1, "Writes are not supported by the 'nowait' engine");
+	if (wratio > 0 && IS_ZCOPY_ENGINE(engine))
+		error(1, -1, "Writes are not supported by the zero-copy "
+		    "engines");
+#ifndef __linux__
+	if (IS_ZCOPY_ENGINE(engine))
+		error(1, -1, "The zero-copy engines are not supported on this "
+		    "system");
+#endif /* __linux__ */
+#ifndef RWF_NOWAIT
+	if (engine == ENGINE_NOWAIT)
+		error(1, -1, "RWF_NOWAIT is not supported on this system");
+#endif /* RWF_NOWAIT */
+	if (wratio > 0 && (opt_record != NULL || opt_replay != NULL))
+		error(1, -1, "Writes can not be recorded nor replayed");
+	if (wratio == 0 && sync != SYNC_NONE)
+		warning(-1, "No writes (-w), the durability policy is ignored");
+
+	/* Open files limit, per thread, within the process limit */
+	if (opt_maxopen) {
+		if (opt_maxopen > 0)
+			maxopen = (size_t) opt_maxopen;
+		else
+			error(1, -1, "Invalid max. open files: %lld",
+			    opt_maxopen);
+	}
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+	    && (rlim_t) maxopen + 64 > rl.rlim_cur)
+		maxopen = rl.rlim_cur > 128 ? (size_t) rl.rlim_cur - 64 : 64;
+	if (maxopen > ds.nfiles * (size_t) nthreads)
+		maxopen = ds.nfiles * (size_t) nthreads;
+	maxopen /= (size_t) nthreads;
+	if (maxopen == 0)
+		maxopen = 1;
 
-		if (opt_prefetch)
-			warning(-1, "Prefetch & FS hints are mutually "
-			    "exclusive");
-	} else if (opt_prefetch)
-		prefetch(fd, start_offset, length);
+	if (opt_give_hints && opt_prefetch)
+		warning(-1, "Prefetch & FS hints are mutually exclusive");
+
+	memset(&job, 0, sizeof(job));
+
+	for (i = 0; i < ds.nfiles; i++) {
+		const struct dsfile *f = &ds.files[i];
+
+		if (!opt_give_hints && !opt_prefetch && i > 0)
+			break;
+
+		fd = open(f->path, O_RDONLY);
+		if (fd == -1)
+			error(1, errno, "Unable to open '%s'", f->path);
+
+		if (opt_give_hints) {
+			int hrc = give_posix_hints(fd, f->start,
+			    (size_t) f->length);
+
+			if (hrc == -1)
+				warning(errno, "Unable to give cache hints "
+				    "for '%s'", f->path);
+		} else if (opt_prefetch)
+			prefetch(fd, f->start, (size_t) f->length);
+
+		/* O_DIRECT requires block aligned offsets, sizes & buffers */
+		if (i == 0 && (opt_direct || opt_compare)) {
+			memset(&sfs, 0, sizeof(sfs));
+			if (fstatfs(fd, &sfs) == -1)
+				error(1, errno, "Unable to get filesystem "
+				    "information for '%s'", f->path);
+			job.dio_align = sfs.f_bsize > 0
+			    ? (size_t) sfs.f_bsize : 4096;
+		}
+
+		if (close(fd) == -1)
+			warning(errno, "Problem closing '%s'", f->path);
+	}
 
 	memset(&tv, 0, sizeof(tv));
 	if (gettimeofday(&tv, NULL) == -1)
 		error(1, errno, "Unable to get time of day");
 
-	seed = (unsigned) tv.tv_usec;
-	srand(seed);
+	if (!opt_seed)
+		seed = (uint64_t) tv.tv_sec * 1000000 + (uint64_t) tv.tv_usec;
 
-	buffer = malloc(maxbsize);
-	if (buffer == NULL)
-		error(1, errno, "Unable to allocate memory for buffer (%lu "
-		    "bytes)", (unsigned long) maxbsize);
+	if (maxbsize < minbsize) {
+		if (!opt_json)
+			printf("minbsize (%lu) > maxbsize (%lu), min <=> "
+			    "max\n", (unsigned long) minbsize,
+			    (unsigned long) maxbsize);
+		size_t m = minbsize; minbsize = maxbsize; maxbsize = m;
+	}
+
+	if (job.dio_align > 0) {
+		alignment = (off_t) roundup_to((size_t) alignment,
+		    job.dio_align);
+		minbsize = roundup_to(minbsize, job.dio_align);
+		maxbsize = roundup_to(maxbsize, job.dio_align);
+	}
+
+	if (opt_replay != NULL)
+		opt_pattern = opt_asap ? "replay (asap)" : "replay";
+	else if (pattern_parse(&job.pattern, opt_pattern) == -1)
+		error(1, -1, "Invalid access pattern: '%s'", opt_pattern);
+	pattern_setup(&job.pattern, (off_t) length,
+	    (off_t) (maxbsize + (size_t) alignment - 1) / alignment * alignment);
+
+	/* Probe for io_uring support before starting anything */
+	if (engine == ENGINE_URING) {
+		struct uring probe;
+
+		if (uring_init(&probe, qdepth) == -1
+		    || uring_probe(&probe) == -1) {
+			warning(errno, "io_uring unavailable, falling back to "
+			    "pread");
+			engine = ENGINE_PREAD;
+			qdepth = 1;
+		}
+		uring_exit(&probe);
+	}
+
+	if (ds.nfiles == 1)
+		snprintf(what, sizeof(what), "'%.40s'", filename);
+	else
+		snprintf(what, sizeof(what), "%lu files",
+		    (unsigned long) ds.nfiles);
+
+	if (toread == SIZE_MAX)
+		snprintf(amount, sizeof(amount), "for %.1f s", opt_duration);
+	else if (opt_duration > 0.0)
+		snprintf(amount, sizeof(amount), "%lu bytes (%.1f s at most)",
+		    (unsigned long) toread, opt_duration);
+	else
+		snprintf(amount, sizeof(amount), "%lu bytes",
+		    (unsigned long) toread);
 
 	offset = start_offset;
-	printf("Will read %lu bytes from '%s', window: [%lu:%lu], minb: "
-	    "%lu, maxb: %lu, alignment: %lu\n",
-	    (unsigned long) toread, filename, (unsigned long) offset,
-	    (unsigned long) (offset + length), (unsigned long) minbsize,
-	    (unsigned long) maxbsize, (unsigned long) alignment);
+	if (!opt_json)
+		printf("Will read %s from %s, window: [%lu:%lu], "
+		    "minb: %lu, maxb: %lu, alignment: %lu, threads: %d, "
+		    "engine: %s, qdepth: %u, pattern: %s%s%s%s, seed: %llu%s\n",
+		    amount, what, (unsigned long) offset,
+		    (unsigned long) (offset + wlength), (unsigned long) minbsize,
+		    (unsigned long) maxbsize, (unsigned long) alignment,
+		    nthreads, engine_names[engine], qdepth, opt_pattern,
+		    opt_compare ? ", buffered & direct" : opt_direct
+		    ? ", direct" : "", IS_MMAP_ENGINE(engine)
+		    ? ", madvise: " : "", IS_MMAP_ENGINE(engine)
+		    ? advice->name : "", (unsigned long long) seed,
+		    opt_pregen && opt_replay == NULL ? " (pregenerated)" : "");
 
-	if (opt_give_hints)
+	if (!opt_json && wratio > 0)
+		printf("Writes: %d%% (overwriting the files), durability "
+		    "policy: %s", wratio, sync_names[sync]);
+	if (!opt_json && wratio > 0 && sync == SYNC_FDATASYNC)
+		printf(" every %u writes", sync_every);
+	if (!opt_json && wratio > 0)
+		printf("\n");
+
+	if (rate > 0.0 && opt_replay != NULL && !opt_asap) {
+		warning(-1, "Replaying with the trace timing, no rate limit");
+		rate = 0.0;
+	}
+	if (!opt_json && rate > 0.0)
+		printf("Rate limit: %.1f %s\n", rate_bytes ? rate / 1e6 : rate,
+		    rate_bytes ? "MB/s" : "IOPS");
+
+	if (opt_json)
+		;
+	else if (ds.nfiles > 1)
+		printf("Dataset: %lu files, %llu bytes, up to %lu open files "
+		    "per thread\n", (unsigned long) ds.nfiles,
+		    (unsigned long long) ds.length, (unsigned long) maxopen);
+
+	if (opt_json)
+		;
+	else if (opt_give_hints)
 		printf("Hints given to the FS, read from window [%lu:%lu] "
-		    "from '%s'\n", (unsigned long) offset,
-		    (unsigned long) (offset + length), filename);
+		    "from %s\n", (unsigned long) offset,
+		    (unsigned long) (offset + wlength), what);
 	else if (opt_prefetch)
 		printf("Instructed the pagecache to prefetch window [%lu:%lu] "
-		    "from '%s'\n", (unsigned long) offset,
-		    (unsigned long) (offset + length), filename);
+		    "from %s\n", (unsigned long) offset,
+		    (unsigned long) (offset + wlength), what);
 
-	if (maxbsize < minbsize) {
-		printf("minbsize (%lu) > maxbsize (%lu), min <=> max\n",
-		    (unsigned long) minbsize, (unsigned long) maxbsize);
-		size_t m = minbsize; minbsize = maxbsize; maxbsize = m;
-		if (realloc(buffer, maxbsize) == NULL)
-			error(1, errno, "Failed to expand buffer to %lu bytes",
-			    maxbsize);
+	job.ds = &ds;
+	job.maxopen = maxopen;
+	job.minbsize = minbsize;
+	job.maxbsize = maxbsize;
+	job.alignment = alignment;
+	job.toread = toread;
+	job.seed = seed;
+	job.pregen = opt_pregen && opt_replay == NULL;
+	job.nthreads = nthreads;
+	job.engine = engine;
+	job.qdepth = qdepth;
+	job.direct = opt_direct;
+	job.advice = advice;
+	job.replay = opt_replay != NULL ? &replay : NULL;
+	job.asap = opt_asap;
+	job.wratio = wratio;
+	job.classify = opt_classify;
+	job.npunters = npunters;
+	job.sync = sync;
+	job.sync_every = sync_every;
+	job.duration = (uint64_t) (opt_duration * 1e9);
+	job.rate = rate;
+	job.rate_bytes = rate_bytes;
+	job.interval = (uint64_t) (opt_interval * 1e9);
+	job.json = opt_json;
+	memset(&series, 0, sizeof(series));
+	memset(&dseries, 0, sizeof(dseries));
+	job.series = &series;
+
+	trace_init(&record);
+	job.trace_ids = NULL;
+	if (opt_record != NULL) {
+		/* The same file can be in the dataset more than once */
+		job.trace_ids = malloc(ds.nfiles * sizeof(*job.trace_ids));
+		if (job.trace_ids == NULL)
+			error(1, errno, "Unable to allocate memory for the "
+			    "trace");
+		for (i = 0; i < ds.nfiles; i++) {
+			if ((tid = trace_path(&record, ds.files[i].path)) == -1)
+				error(1, errno, "Unable to allocate memory for "
+				    "the trace");
+			job.trace_ids[i] = (uint32_t) tid;
+		}
+		job.record = &record;
 	}
 
-	while (toread > 0) {
-		if (toread < maxbsize)
-			maxbsize = toread;
+	workers = calloc((size_t) nthreads, sizeof(*workers));
+	if (workers == NULL)
+		error(1, errno, "Unable to allocate memory for %d workers",
+		    nthreads);
+
+	if (opt_compare) {
+		dworkers = calloc((size_t) nthreads, sizeof(*dworkers));
+		if (dworkers == NULL)
+			error(1, errno, "Unable to allocate memory for %d "
+			    "workers", nthreads);
 
-		if (maxbsize < minbsize)
-			minbsize = maxbsize;
+		/* Only the buffered run is recorded */
+		job.direct = 0;
+		run(&job, workers, total, &elapsed);
+		job.direct = 1;
+		job.record = NULL;
+		job.series = &dseries;
+		run(&job, dworkers, dtotal, &delapsed);
 
-		bsize = minbsize + (size_t) ((double) (maxbsize - minbsize)
-			* (double) rand() / (double) RAND_MAX);
-		offset = start_offset + (off_t) ((double) length
-			* (double) rand() / (double) RAND_MAX);
+		if (opt_json) {
+			printf("{ \"buffered\":\n");
+			job.direct = 0;
+			job.series = &series;
+			print_json(&job, workers, total, elapsed);
+			printf(", \"direct\":\n");
+			job.direct = 1;
+			job.series = &dseries;
+			print_json(&job, dworkers, dtotal, delapsed);
+			printf("}\n");
+		} else {
+			for (a = 0; a < OP_COUNT; a++)
+				if (op_shown(&job, a))
+					print_compare((enum op) a, &total[a],
+					    elapsed, &dtotal[a], delapsed);
+			cpu_total(&job, workers, &cpu);
+			cpu_total(&job, dworkers, &dcpu);
+			print_compare_cpu(&cpu, total[OP_READ].nbytes
+			    + total[OP_WRITE].nbytes, &dcpu,
+			    dtotal[OP_READ].nbytes + dtotal[OP_WRITE].nbytes);
+		}
+		free(dworkers);
+	} else {
+		run(&job, workers, total, &elapsed);
+		if (opt_json)
+			print_json(&job, workers, total, elapsed);
+		else
+			report(&job, workers, total, elapsed);
+	}
+	free(workers);
 
-		if (offset > st.st_size)
-			offset = st.st_size;
+	if (opt_record != NULL) {
+		trace_sort(&record);
+		if (trace_write(&record, opt_record) == -1)
+			error(1, errno, "Unable to write trace '%s'",
+			    opt_record);
+		if (!opt_json)
+			printf("Recorded %lu reads in '%s'\n",
+			    (unsigned long) record.nrecs, opt_record);
+	}
+	free(series.samples);
+	free(dseries.samples);
+	trace_free(&record);
+	free(job.trace_ids);
+	trace_free(&replay);
+	dataset_free(&ds);
 
-		offset -= offset % alignment;
+	return (0);
+}
 
-		if (offset >= (off_t) bsize)
-			offset -= (off_t) bsize;
 
-		if (opt_pread)
-			nr = pread(fd, buffer, bsize, offset);
-		else {
-			if (lseek(fd, offset, SEEK_SET) != offset)
+/* Rounds 'v' up to a multiple of 'a' */
+size_t
+roundup_to(size_t v, size_t a)
+{
+	return ((v + a - 1) / a * a);
+}
+
+
+/*
+ * Runs the job once: opens the descriptors, starts the reader threads &
+ * waits for them.  The aggregate stats & elapsed time (over the union of the
+ * threads runs) are stored in 'total' (one per operation) & 'elapsed'.
+ */
+void
+run(struct job *job, struct worker *workers, struct stats *total,
+    double *elapsed)
+{
+	size_t		 slots = job->maxbsize * job->qdepth;
+	size_t		 pagesize = (size_t) sysconf(_SC_PAGESIZE);
+	struct punt	 pool;
+	uint64_t	 t_first, t_last;
+	size_t		 i;
+	int		 nthreads = job->nthreads, flags = O_RDONLY, rc, t, o;
+
+	if (job->wratio > 0)
+		flags = O_RDWR;
+#ifdef O_DSYNC
+	if (job->sync == SYNC_DSYNC)
+		flags |= O_DSYNC;
+#endif /* O_DSYNC */
+
+	if (job->direct) {
+#ifdef O_DIRECT
+		flags |= O_DIRECT;
+#else
+		error(1, -1, "O_DIRECT is not supported on this system");
+#endif /* O_DIRECT */
+	}
+
+	rc = pthread_barrier_init(&job->start, NULL, (unsigned) nthreads + 1);
+	if (rc != 0)
+		error(1, rc, "Unable to initialize start barrier");
+
+	for (t = 0; t < nthreads; t++) {
+		struct worker *w = &workers[t];
+
+		memset(w, 0, sizeof(*w));
+		w->job = job;
+		w->id = t;
+		rng_seed(&w->rng, job->seed + (uint64_t) t);
+		w->cursor = pattern_start(&job->pattern, t, nthreads);
+		w->toread = job->toread / (size_t) nthreads;
+		if (t == 0)
+			w->toread += job->toread % (size_t) nthreads;
+		/* Replayed reads end with the trace */
+		if (job->replay != NULL)
+			w->toread = SIZE_MAX;
+		w->rnext = (size_t) t;
+		trace_init(&w->rec);
+		if (job->pregen)
+			pregenerate(w);
+
+		/* The files are also mapped for mincore() when classifying */
+		if (fdcache_init(&w->fc, job->ds, job->maxopen, flags,
+		    IS_MMAP_ENGINE(job->engine) ? job->advice->advice
+		    : job->classify ? MADV_NORMAL : -1, job->maxbsize) == -1)
+			error(1, errno, "Unable to allocate memory for the "
+			    "open files of thread %d", t);
+
+		/* Open (& map) as many files as allowed beforehand */
+		for (i = 0; i < job->ds->nfiles && i < job->maxopen; i++) {
+			get_file(w, i);
+			fdcache_put(&w->fc, i);
+		}
+
+		for (o = 0; o < OP_COUNT; o++) {
+			hist_init(&w->st[o].lat);
+			hist_init(&w->ist[o].lat);
+		}
+		rc = pthread_mutex_init(&w->lock, NULL);
+		if (rc != 0)
+			error(1, rc, "Unable to initialize lock");
+
+		/* Spreads the threads schedules over one period */
+		if (job->rate > 0.0)
+			w->phase = (uint64_t) ((double) t * 1e9 / job->rate
+			    * (job->rate_bytes ? (double) (job->minbsize
+			    + job->maxbsize) / 2.0 : 1.0));
+
+		/* Page aligned, suitable for O_DIRECT */
+		rc = posix_memalign((void **) &w->buffer,
+		    (size_t) sysconf(_SC_PAGESIZE), slots);
+		if (rc != 0)
+			error(1, rc, "Unable to allocate memory for buffer "
+			    "(%lu bytes)", (unsigned long) slots);
+		/* What is written */
+		memset(w->buffer, 0x5a, slots);
+
+		if (job->classify) {
+			w->vec = malloc(job->maxbsize / pagesize + 2);
+			if (w->vec == NULL)
+				error(1, errno, "Unable to allocate memory for "
+				    "mincore() vector");
+		}
+
+		if (job->engine == ENGINE_NOWAIT) {
+			rc = punt_cq_init(&w->cq);
+			if (rc != 0)
+				error(1, rc, "Unable to initialize completion "
+				    "queue");
+		}
+
+		w->sink = w->pipe[0] = w->pipe[1] = -1;
+		if (IS_ZCOPY_ENGINE(job->engine)) {
+			w->sink = open("/dev/null", O_WRONLY);
+			if (w->sink == -1)
+				error(1, errno, "Unable to open '/dev/null'");
+		}
+		if (job->engine == ENGINE_SPLICE) {
+			if (pipe(w->pipe) == -1)
+				error(1, errno, "Unable to create pipe");
+#ifdef F_SETPIPE_SZ
+			/* Large enough for a whole read, if allowed */
+			fcntl(w->pipe[1], F_SETPIPE_SZ, (int) job->maxbsize);
+#endif /* F_SETPIPE_SZ */
+		}
+
+		if (job->engine == ENGINE_URING
+		    && uring_init(&w->ring, job->qdepth) == -1)
+			error(1, errno, "Unable to setup io_uring for thread "
+			    "%d", t);
+	}
+
+	if (job->engine == ENGINE_NOWAIT) {
+		rc = punt_init(&pool, job->npunters);
+		if (rc != 0)
+			error(1, rc, "Unable to start the pool of threads");
+		job->punt = &pool;
+	}
+
+	for (t = 0; t < nthreads; t++) {
+		rc = pthread_create(&workers[t].tid, NULL, reader, &workers[t]);
+		if (rc != 0)
+			error(1, rc, "Unable to create reader thread %d", t);
+	}
+
+	job->nrunning = nthreads;
+	job->series->n = 0;
+	job->t_base = now_ns();
+	pthread_barrier_wait(&job->start);
+
+	/* Interval reports, until all the threads are done */
+	if (job->interval > 0) {
+		uint64_t prev = job->t_base, next = prev + job->interval, now;
+
+		while (__atomic_load_n(&job->nrunning, __ATOMIC_ACQUIRE) > 0) {
+			now = now_ns();
+			if (now < next) {
+				wait_until(next - now > 10000000ULL
+				    ? now + 10000000ULL : next);
+				continue;
+			}
+			take_sample(job, workers, prev, now);
+			prev = now;
+			next += job->interval;
+		}
+		/* Last, partial, interval: up to the end of the last thread */
+		for (now = prev, t = 0; t < nthreads; t++)
+			if (workers[t].t_end > now)
+				now = workers[t].t_end;
+		if (now > prev)
+			take_sample(job, workers, prev, now);
+	}
+
+	for (t = 0; t < nthreads; t++) {
+		rc = pthread_join(workers[t].tid, NULL);
+		if (rc != 0)
+			error(1, rc, "Unable to join reader thread %d", t);
+	}
+
+	memset(total, 0, OP_COUNT * sizeof(*total));
+	for (o = 0; o < OP_COUNT; o++)
+		hist_init(&total[o].lat);
+	t_first = workers[0].t_start;
+	t_last = workers[0].t_end;
+	for (t = 0; t < nthreads; t++) {
+		struct worker *w = &workers[t];
+
+		if (w->t_start < t_first)
+			t_first = w->t_start;
+		if (w->t_end > t_last)
+			t_last = w->t_end;
+
+		for (o = 0; o < OP_COUNT; o++) {
+			total[o].nops += w->st[o].nops;
+			total[o].nbytes += w->st[o].nbytes;
+			hist_merge(&total[o].lat, &w->st[o].lat);
+		}
+
+		if (job->record != NULL
+		    && trace_merge(job->record, &w->rec) == -1)
+			error(1, errno, "Unable to allocate memory for the "
+			    "trace");
+		trace_free(&w->rec);
+		pthread_mutex_destroy(&w->lock);
+
+		if (job->engine == ENGINE_URING)
+			uring_exit(&w->ring);
+		if (job->engine == ENGINE_NOWAIT)
+			punt_cq_fini(&w->cq);
+		if (w->sink != -1)
+			close(w->sink);
+		if (w->pipe[0] != -1) {
+			close(w->pipe[0]);
+			close(w->pipe[1]);
+		}
+
+		fdcache_fini(&w->fc);
+
+		free(w->buffer);
+		w->buffer = NULL;
+		free(w->vec);
+		w->vec = NULL;
+		free(w->sched);
+		w->sched = NULL;
+	}
+	*elapsed = (double) (t_last - t_first) / 1e9;
+
+	if (job->punt != NULL) {
+		punt_fini(job->punt);
+		job->punt = NULL;
+	}
+
+	pthread_barrier_destroy(&job->start);
+}
+
+
+void
+report(const struct job *job, const struct worker *workers,
+    const struct stats *total, double elapsed)
+{
+	struct cpustat	 cpu;
+	char		 label[32];
+	int		 t, o;
+
+	if (job->nthreads > 1) {
+		for (t = 0; t < job->nthreads; t++) {
+			const struct worker *w = &workers[t];
+
+			snprintf(label, sizeof(label), "Thread %d", t);
+			for (o = 0; o < OP_COUNT; o++)
+				if (op_shown(job, o))
+					print_text(label, (enum op) o,
+					    &w->st[o], (double) (w->t_end
+					    - w->t_start) / 1e9);
+			print_cpu(label, &w->cpu, w->st[OP_READ].nbytes
+			    + w->st[OP_WRITE].nbytes);
+		}
+	}
+	for (o = 0; o < OP_COUNT; o++)
+		if (op_shown(job, o))
+			print_text(job->direct ? "Total (direct)" : "Total",
+			    (enum op) o, &total[o], elapsed);
+	cpu_total(job, workers, &cpu);
+	print_cpu(job->direct ? "Total (direct)" : "Total", &cpu,
+	    total[OP_READ].nbytes + total[OP_WRITE].nbytes);
+
+	if (job->classify && total[OP_READ].nops > 0)
+		printf("Hit ratio: %.2f%%\n", 100.0
+		    * (double) total[OP_HIT].nops
+		    / (double) total[OP_READ].nops);
+
+	if (job->engine == ENGINE_NOWAIT && total[OP_READ].nops > 0) {
+		const struct hist *h = &total[OP_QUEUED].lat;
+
+		printf("Served inline: %.2f%%", 100.0
+		    * (double) total[OP_INLINE].nops
+		    / (double) total[OP_READ].nops);
+		if (h->count > 0)
+			printf(", punted reads queueing (us): avg %.1f, "
+			    "p50 %.1f, p99 %.1f, max %.1f", hist_mean(h) / 1e3,
+			    (double) hist_percentile(h, 50.0) / 1e3,
+			    (double) hist_percentile(h, 99.0) / 1e3,
+			    (double) h->max / 1e3);
+		printf("\n");
+	}
+}
+
+
+/* Whether the stats of that operation are relevant for the job */
+int
+op_shown(const struct job *job, int op)
+{
+	switch (op) {
+	case OP_WRITE:
+		return (job->wratio > 0);
+	case OP_HIT:
+	case OP_MISS:
+		return (job->classify);
+	case OP_INLINE:
+	case OP_PUNTED:
+		return (job->engine == ENGINE_NOWAIT);
+	case OP_QUEUED:
+		return (0);		/* only its latency is meaningful */
+	default:
+		return (1);
+	}
+}
+
+
+/* "none", "fdatasync[:N]", "range" or "dsync" */
+void
+parse_sync(const char *spec, enum sync_policy *sync, unsigned *every)
+{
+	const char	*arg = strchr(spec, ':');
+	size_t		 len = arg != NULL ? (size_t) (arg - spec) : strlen(spec);
+	int		 p;
+
+	for (p = 0; p < SYNC_COUNT; p++) {
+		if (strlen(sync_names[p]) == len
+		    && strncmp(spec, sync_names[p], len) == 0)
+			break;
+	}
+	if (p == SYNC_COUNT || (arg != NULL && p != SYNC_FDATASYNC))
+		error(1, -1, "Unknown durability policy: '%s'", spec);
+
+	*sync = (enum sync_policy) p;
+	*every = 1;
+	if (arg != NULL) {
+		long long int n = atoll(arg + 1);
+
+		if (n <= 0 || n > UINT32_MAX)
+			error(1, -1, "Invalid fdatasync() interval: '%s'",
+			    arg + 1);
+		*every = (unsigned) n;
+	}
+#ifndef SYNC_FILE_RANGE_WRITE
+	if (*sync == SYNC_RANGE)
+		error(1, -1, "sync_file_range() is not supported on this "
+		    "system");
+#endif /* SYNC_FILE_RANGE_WRITE */
+#ifndef O_DSYNC
+	if (*sync == SYNC_DSYNC)
+		error(1, -1, "O_DSYNC is not supported on this system");
+#endif /* O_DSYNC */
+}
+
+
+/* "N" or "Niops" for IOPS, "NMB" for MB/s */
+void
+parse_rate(const char *spec, double *rate, int *bytes)
+{
+	char *ep;
+
+	*rate = strtod(spec, &ep);
+	*bytes = 0;
+	if (strcasecmp(ep, "mb") == 0 || strcasecmp(ep, "mb/s") == 0) {
+		*rate *= 1e6;
+		*bytes = 1;
+	} else if (*ep != '\0' && strcasecmp(ep, "iops") != 0)
+		*rate = -1.0;
+
+	if (*rate <= 0.0)
+		error(1, -1, "Invalid rate: '%s'", spec);
+}
+
+
+enum engine
+parse_engine(const char *name)
+{
+	int e;
+
+	for (e = 0; e < ENGINE_COUNT; e++) {
+		if (strcmp(name, engine_names[e]) == 0)
+			return ((enum engine) e);
+	}
+	error(1, -1, "Unknown I/O engine: '%s'", name);
+
+	return (ENGINE_READ);
+}
+
+
+const struct advice *
+parse_advice(const char *name)
+{
+	const struct advice *a;
+
+	for (a = advices; a->name != NULL; a++) {
+		if (strcmp(name, a->name) == 0)
+			return (a);
+	}
+	error(1, -1, "Unknown or unsupported madvise() advice: '%s'", name);
+
+	return (&advices[0]);
+}
+
+
+/* Returns the open (& mapped) file, opening it if needed */
+struct ofile *
+get_file(struct worker *w, size_t idx)
+{
+	struct ofile *of;
+
+	of = fdcache_get(&w->fc, idx);
+	if (of == NULL)
+		error(1, errno, "Unable to open '%s'",
+		    w->job->ds->files[idx].path);
+
+	return (of);
+}
+
+
+/* Sleeps until 'ns' (monotonic clock) */
+void
+wait_until(uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) (ns / 1000000000ULL);
+	ts.tv_nsec = (long) (ns % 1000000000ULL);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+	    == EINTR)
+		;
+}
+
+
+/*
+ * Whether all the pages the read will touch are in the pagecache, from the
+ * mapping of the file
+ */
+enum op
+classify(struct worker *w, const struct ofile *of, const struct req *rq)
+{
+	size_t	pagesize = (size_t) sysconf(_SC_PAGESIZE);
+	size_t	first, last, k;
+	off_t	pos = rq->offset - of->map_offset;
+
+	if (of->map == NULL || pos < 0 || (size_t) pos >= of->map_len)
+		return (OP_READ);
+
+	first = (size_t) pos / pagesize;
+	last = ((size_t) pos + rq->bsize - 1) / pagesize;
+	if (last * pagesize >= of->map_len)
+		last = (of->map_len - 1) / pagesize;
+
+	if (mincore(of->map + first * pagesize, (last - first + 1) * pagesize,
+	    w->vec) == -1)
+		return (OP_READ);
+
+	for (k = 0; k <= last - first; k++)
+		if ((w->vec[k] & 1) == 0)
+			return (OP_MISS);
+
+	return (OP_HIT);
+}
+
+
+/* Applies the durability policy after a write */
+void
+sync_write(struct worker *w, int fd, const struct req *rq)
+{
+	const struct job *j = w->job;
+
+	w->nwrites++;
+	switch (j->sync) {
+	case SYNC_FDATASYNC:
+		if (w->nwrites % j->sync_every == 0 && fdatasync(fd) == -1)
+			warning(errno, "Unable to sync '%s'",
+			    j->ds->files[rq->file].path);
+		break;
+	case SYNC_RANGE:
+#ifdef SYNC_FILE_RANGE_WRITE
+		/* Starts the writeback of the range, without waiting */
+		if (sync_file_range(fd, rq->offset, (off_t) rq->bsize,
+		    SYNC_FILE_RANGE_WRITE) == -1)
+			warning(errno, "Unable to start writeback of '%s'",
+			    j->ds->files[rq->file].path);
+#endif /* SYNC_FILE_RANGE_WRITE */
+		break;
+	default:
+		break;
+	}
+}
+
+
+/*
+ * Loads the trace to replay & makes a dataset of its (regular) files, the
+ * records are renumbered after the dataset files, those of the files which
+ * can not be read are dropped.
+ */
+void
+setup_replay(struct trace *tr, struct dataset *ds, const char *path)
+{
+	struct stat	 st;
+	size_t		*map, i, n, dropped = 0;
+
+	if (trace_read(tr, path) == -1)
+		error(1, errno, "Unable to read trace '%s'", path);
+
+	map = malloc((tr->npaths + 1) * sizeof(*map));
+	if (map == NULL)
+		error(1, errno, "Unable to allocate memory for the trace");
+
+	for (i = 0; i < tr->npaths; i++) {
+		map[i] = SIZE_MAX;
+		if (lstat(tr->paths[i], &st) == -1)
+			warning(errno, "Unable to stat '%s'", tr->paths[i]);
+		else if (!S_ISREG(st.st_mode))
+			warning(-1, "'%s' is not a regular file",
+			    tr->paths[i]);
+		else if (st.st_size > 0) {
+			if (dataset_add(ds, tr->paths[i]) == -1)
+				error(1, errno, "Unable to add '%s'",
+				    tr->paths[i]);
+			map[i] = ds->nfiles - 1;
+		}
+	}
+	dataset_window(ds, 0, 0);
+
+	for (i = n = 0; i < tr->nrecs; i++) {
+		if (map[tr->recs[i].file] == SIZE_MAX) {
+			dropped++;
+			continue;
+		}
+		tr->recs[n] = tr->recs[i];
+		tr->recs[n++].file = (uint32_t) map[tr->recs[i].file];
+	}
+	tr->nrecs = n;
+	free(map);
+
+	if (dropped > 0)
+		warning(-1, "%lu reads of '%s' dropped (unreadable files)",
+		    (unsigned long) dropped, path);
+	if (tr->nrecs == 0)
+		error(1, -1, "No read to replay in '%s'", path);
+}
+
+
+/*
+ * Moves the data to /dev/null without copying it to user space, either with
+ * sendfile() or with splice() through a pipe (drained each time, as a pipe
+ * holds a limited number of pages), returns the number of bytes moved.
+ */
+ssize_t
+zcopy_read(struct worker *w, const struct ofile *of, off_t offset,
+    size_t bsize)
+{
+#ifdef __linux__
+	loff_t	 off = offset;
+	off_t	 soff = offset;
+	size_t	 done = 0;
+	ssize_t	 n, m, k;
+
+	while (done < bsize) {
+		if (w->job->engine == ENGINE_SENDFILE)
+			n = sendfile(w->sink, of->fd, &soff, bsize - done);
+		else
+			n = splice(of->fd, &off, w->pipe[1], NULL,
+			    bsize - done, SPLICE_F_MOVE);
+		if (n == -1)
+			return (-1);
+		if (n == 0)
+			break;		/* end of file */
+
+		for (m = w->job->engine == ENGINE_SPLICE ? n : 0; m > 0;
+		    m -= k) {
+			k = splice(w->pipe[0], NULL, w->sink, NULL, (size_t) m,
+			    SPLICE_F_MOVE);
+			if (k <= 0) {
+				if (k == 0)
+					errno = EIO;
+				return (-1);
+			}
+		}
+		done += (size_t) n;
+	}
+
+	return ((ssize_t) done);
+#else
+	(void) w;
+	(void) of;
+	(void) offset;
+	(void) bsize;
+	errno = ENOSYS;
+
+	return (-1);
+#endif /* __linux__ */
+}
+
+
+/*
+ * "Reads" from the mapping: either copies the data to the buffer or touches
+ * one byte per page, returns the number of bytes covered.
+ */
+ssize_t
+map_read(struct worker *w, const struct ofile *of, off_t offset, size_t bsize)
+{
+	const unsigned char	*p;
+	size_t			 pos, n, k, pagesize;
+	unsigned char		 sum = 0;
+
+	if (offset < of->map_offset)
+		offset = of->map_offset;
+	pos = (size_t) (offset - of->map_offset);
+	if (pos >= of->map_len)
+		return (0);
+
+	n = of->map_len - pos < bsize ? of->map_len - pos : bsize;
+	p = of->map + pos;
+
+	if (w->job->engine == ENGINE_MMAP) {
+		memcpy(w->buffer, p, n);
+		return ((ssize_t) n);
+	}
+
+	pagesize = (size_t) sysconf(_SC_PAGESIZE);
+	for (k = 0; k < n; k += pagesize - (pos + k) % pagesize)
+		sum += p[k];
+	w->touched += sum;
+
+	return ((ssize_t) n);
+}
+
+
+/*
+ * Chooses the file, offset & size of the next read, 'remaining' is what is
+ * left to read from the thread share.  When replaying, the thread reads are
+ * every 'nthreads' record of the trace from its id on.  Returns 0 when there
+ * is nothing left to read.
+ */
+int
+next_read(struct worker *w, size_t remaining, struct req *rq)
+{
+	struct job		*j = w->job;
+	const struct trace_rec	*tr;
+
+	if (j->duration > 0 && now_ns() - j->t_base >= j->duration)
+		return (0);
+
+	if (j->replay != NULL) {
+		if (w->rnext >= j->replay->nrecs)
+			return (0);
+		tr = &j->replay->recs[w->rnext];
+		w->rnext += (size_t) j->nthreads;
+
+		rq->op = rq->cls = OP_READ;
+		rq->file = tr->file;
+		rq->offset = (off_t) tr->offset;
+		rq->bsize = tr->size;
+		rq->due = j->asap ? 0 : j->t_base + tr->ts;
+		if (j->dio_align > 0) {
+			rq->offset -= rq->offset % (off_t) j->dio_align;
+			rq->bsize = roundup_to(rq->bsize, j->dio_align);
+		}
+		if (j->rate > 0.0)
+			pace(w, rq);
+		return (1);
+	}
+
+	if (w->sched != NULL) {
+		/* The schedule covers the thread share, cycled if timed */
+		if (w->snext == w->nsched)
+			w->snext = 0;
+		*rq = w->sched[w->snext++];
+	} else
+		draw_read(w, remaining, rq);
+
+	if (j->rate > 0.0)
+		pace(w, rq);
+
+	return (1);
+}
+
+
+/* Draws the file, offset & size of the next read */
+void
+draw_read(struct worker *w, size_t remaining, struct req *rq)
+{
+	const struct job	*j = w->job;
+	const struct dsfile	*f;
+	size_t			 minbsize = j->minbsize, maxbsize = j->maxbsize;
+	size_t			 bsize;
+	off_t			 vpos, offset;
+
+	if (remaining < maxbsize)
+		maxbsize = remaining;
+
+	if (maxbsize < minbsize)
+		minbsize = maxbsize;
+
+	bsize = minbsize + (size_t) rng_below(&w->rng,
+	    (uint64_t) (maxbsize - minbsize) + 1);
+
+	/*
+	 * O_DIRECT: whole blocks only, even past what is left to read (also
+	 * done for the buffered run of a comparison, to get the same reads)
+	 */
+	if (j->dio_align > 0) {
+		bsize -= bsize % j->dio_align;
+		if (bsize == 0)
+			bsize = j->dio_align;
+	}
+	vpos = pattern_next(&j->pattern, &w->cursor, bsize, &w->rng);
+	rq->file = dataset_locate(j->ds, vpos);
+	f = &j->ds->files[rq->file];
+	offset = f->start + (vpos - f->vstart);
+
+	if (offset > f->size)
+		offset = f->size;
+
+	offset -= offset % j->alignment;
+
+	/* Keep random reads from running past the end of the window */
+	if (pattern_is_random(&j->pattern) && offset >= (off_t) bsize)
+		offset -= (off_t) bsize;
+
+	rq->op = rq->cls = OP_READ;
+	rq->offset = offset;
+	rq->bsize = bsize;
+	rq->due = 0;
+
+	/* Writes stay within the file, in whole blocks for O_DIRECT */
+	if (j->wratio > 0 && (int) rng_below(&w->rng, 100) < j->wratio) {
+		if (offset + (off_t) bsize > f->size)
+			bsize = (size_t) (f->size - offset);
+		if (j->dio_align > 0)
+			bsize -= bsize % j->dio_align;
+		if (bsize > 0) {
+			rq->op = OP_WRITE;
+			rq->bsize = bsize;
+		}
+	}
+}
+
+
+/*
+ * Draws all the reads of the thread before the run, so that the generator
+ * stays out of the timed loop: the thread share, or the default size share
+ * for the timed runs, which cycle through it.
+ */
+void
+pregenerate(struct worker *w)
+{
+	const struct job	*j = w->job;
+	struct req		*sched;
+	size_t			 left = w->toread, alloc = 0;
+
+	if (j->toread == SIZE_MAX) {
+		left = (size_t) j->ds->length / 8 / (size_t) j->nthreads;
+		if (left < j->maxbsize)
+			left = j->maxbsize;
+	}
+
+	while (left > 0) {
+		if (w->nsched == alloc) {
+			alloc = alloc ? alloc * 2 : 4096;
+			sched = realloc(w->sched, alloc * sizeof(*sched));
+			if (sched == NULL)
+				error(1, errno, "Unable to allocate memory for "
+				    "the schedule of thread %d (%lu reads)",
+				    w->id, (unsigned long) alloc);
+			w->sched = sched;
+		}
+		draw_read(w, left, &w->sched[w->nsched]);
+		left -= w->sched[w->nsched].bsize < left
+		    ? w->sched[w->nsched].bsize : left;
+		w->nsched++;
+	}
+}
+
+
+void *
+reader(void *arg)
+{
+	struct worker	*w = arg;
+	struct cpuprobe	 probe;
+
+	if (cpuprobe_open(&probe) == -1 && w->id == 0 && errno != ENOSYS)
+		warning(errno, "perf counters unavailable, CPU usage from "
+		    "getrusage() only");
+
+	pthread_barrier_wait(&w->job->start);
+	cpuprobe_start(&probe);
+	w->t_start = now_ns();
+
+	if (w->job->engine == ENGINE_URING)
+		read_uring(w);
+	else if (w->job->engine == ENGINE_NOWAIT)
+		read_nowait(w);
+	else
+		read_sync(w);
+
+	w->t_end = now_ns();
+	cpuprobe_stop(&probe, &w->cpu);
+	__atomic_sub_fetch(&w->job->nrunning, 1, __ATOMIC_RELEASE);
+
+	return (NULL);
+}
+
+
+/*
+ * One blocking read at a time, with lseek() & read(), pread() or from the
+ * mapping
+ */
+void
+read_sync(struct worker *w)
+{
+	struct job	*j = w->job;
+	struct ofile	*of;
+	struct req	 rq;
+	size_t		 toread = w->toread;
+	ssize_t		 nr;
+	uint64_t	 t0, lat;
+
+	while (toread > 0 && next_read(w, toread, &rq)) {
+		of = get_file(w, rq.file);
+		if (j->classify && rq.op == OP_READ)
+			rq.cls = classify(w, of, &rq);
+		if (rq.due > 0)
+			wait_until(rq.due);
+
+		t0 = now_ns();
+		if (rq.op == OP_WRITE) {
+			if (j->engine == ENGINE_PREAD)
+				nr = pwrite(of->fd, w->buffer, rq.bsize,
+				    rq.offset);
+			else if (lseek(of->fd, rq.offset, SEEK_SET)
+			    != rq.offset)
+				nr = -1;
+			else
+				nr = write(of->fd, w->buffer, rq.bsize);
+			if (nr == -1)
+				error(1, errno, "Error while writing '%s', "
+				    "offset: %lu", j->ds->files[rq.file].path,
+				    (unsigned long) rq.offset);
+
+			sync_write(w, of->fd, &rq);
+			account_op(w, OP_WRITE, nr, now_ns() - t0);
+			fdcache_put(&w->fc, rq.file);
+			toread -= (size_t) nr < toread ? (size_t) nr : toread;
+			continue;
+		}
+
+		switch (j->engine) {
+		case ENGINE_PREAD:
+			nr = pread(of->fd, w->buffer, rq.bsize, rq.offset);
+			break;
+		case ENGINE_MMAP:
+		case ENGINE_MMAP_TOUCH:
+			nr = map_read(w, of, rq.offset, rq.bsize);
+			break;
+		case ENGINE_SENDFILE:
+		case ENGINE_SPLICE:
+			nr = zcopy_read(w, of, rq.offset, rq.bsize);
+			break;
+		default:
+			if (lseek(of->fd, rq.offset, SEEK_SET) != rq.offset)
 				warning(errno, "Unable to seek to %lu in '%s'",
-				    (unsigned long) offset, filename);
+				    (unsigned long) rq.offset,
+				    j->ds->files[rq.file].path);
 
-			nr = read(fd, buffer, bsize);
+			nr = read(of->fd, w->buffer, rq.bsize);
+			break;
 		}
 		if (nr == -1)
 			error(1, errno, "Error while reading '%s', offset: %lu",
-			    filename, (unsigned long) offset);
+			    j->ds->files[rq.file].path,
+			    (unsigned long) rq.offset);
+
+		lat = now_ns() - t0;
+		account_op(w, OP_READ, nr, lat);
+		if (rq.cls != OP_READ)
+			account_op(w, rq.cls, nr, lat);
+		fdcache_put(&w->fc, rq.file);
+
+		if (j->record != NULL && trace_add(&w->rec,
+		    j->trace_ids[rq.file], rq.offset, rq.bsize,
+		    t0 - j->t_base) == -1)
+			error(1, errno, "Unable to allocate memory for the "
+			    "trace");
 
-		toread -= (size_t) nr;
+		toread -= (size_t) nr < toread ? (size_t) nr : toread;
 	}
-	if (close(fd) == -1)
-		warning(errno, "Problem closing '%s'", filename);
+}
 
-	free(buffer);
 
-	return (0);
+/*
+ * Keeps up to 'qdepth' reads in flight: the free buffer slots are refilled
+ * with new reads, submitted in one batch, then all the available completions
+ * are reaped.  The amount of data left to read is accounted for when a read
+ * is queued, so a short read near the end of the file is not retried.
+ * Replayed reads are only queued once due, while waiting for them the
+ * completions are polled.
+ */
+void
+read_uring(struct worker *w)
+{
+	struct job	*j = w->job;
+	struct ofile	*of;
+	struct req	 rq, *reqs;
+	const struct req *done;
+	unsigned char	*buf;
+	unsigned	*freeslots, *batch;
+	uint64_t	*issued;
+	unsigned	 nfree = j->qdepth, inflight = 0, nbatch = 0, s, b;
+	size_t		 toqueue = w->toread;
+	uint64_t	 slot, now, lat;
+	int32_t		 res;
+	int		 pending = 0, rc;
+
+	freeslots = malloc(j->qdepth * sizeof(*freeslots));
+	batch = malloc(j->qdepth * sizeof(*batch));
+	issued = malloc(j->qdepth * sizeof(*issued));
+	reqs = malloc(j->qdepth * sizeof(*reqs));
+	if (freeslots == NULL || batch == NULL || issued == NULL
+	    || reqs == NULL)
+		error(1, errno, "Unable to allocate memory for %u slots",
+		    j->qdepth);
+	for (s = 0; s < j->qdepth; s++)
+		freeslots[s] = s;
+
+	while (toqueue > 0 || inflight > 0) {
+		while (toqueue > 0 && nfree > 0) {
+			if (!pending && !next_read(w, toqueue, &rq)) {
+				toqueue = 0;
+				break;
+			}
+			pending = 1;
+			if (rq.due > 0 && rq.due > now_ns())
+				break;
+			pending = 0;
+
+			of = get_file(w, rq.file);
+			if (j->classify && rq.op == OP_READ)
+				rq.cls = classify(w, of, &rq);
+			s = freeslots[--nfree];
+			buf = w->buffer + (size_t) s * j->maxbsize;
+			if (rq.op == OP_WRITE)
+				rc = uring_prep_write(&w->ring, of->fd, buf,
+				    rq.bsize, rq.offset, (uint64_t) s);
+			else
+				rc = uring_prep_read(&w->ring, of->fd, buf,
+				    rq.bsize, rq.offset, (uint64_t) s);
+			if (rc == -1)
+				error(1, errno, "Unable to queue I/O");
+			reqs[s] = rq;
+			batch[nbatch++] = s;
+			toqueue -= rq.bsize < toqueue ? rq.bsize : toqueue;
+			inflight++;
+		}
+
+		/* The reads prepared are issued by the submission below */
+		now = now_ns();
+		for (b = 0; b < nbatch; b++) {
+			s = batch[b];
+			issued[s] = now;
+			if (j->record != NULL && trace_add(&w->rec,
+			    j->trace_ids[reqs[s].file], reqs[s].offset,
+			    reqs[s].bsize, now - j->t_base) == -1)
+				error(1, errno, "Unable to allocate memory for "
+				    "the trace");
+		}
+		nbatch = 0;
+
+		/*
+		 * Waits for a completion, unless the next read is pending
+		 * with a free slot (waited for below): with all the slots
+		 * in use, nothing else can be done.
+		 */
+		if (uring_submit(&w->ring, inflight > 0 && (!pending
+		    || nfree == 0) ? 1 : 0) == -1)
+			error(1, errno, "Unable to submit reads");
+
+		now = now_ns();
+		while (uring_reap(&w->ring, &slot, &res) == 1) {
+			done = &reqs[slot];
+			if (res < 0)
+				error(1, -res, "Error while %s '%s'",
+				    done->op == OP_WRITE ? "writing" : "reading",
+				    j->ds->files[done->file].path);
+
+			lat = now - issued[slot];
+			account_op(w, done->op, res, lat);
+			if (done->cls != OP_READ)
+				account_op(w, done->cls, res, lat);
+			if (done->op == OP_WRITE)
+				sync_write(w, w->fc.of[done->file].fd, done);
+			fdcache_put(&w->fc, done->file);
+			freeslots[nfree++] = (unsigned) slot;
+			inflight--;
+		}
+
+		/* Not due yet: sleep a bit at most with reads in flight */
+		if (pending && nfree > 0) {
+			now = now_ns();
+			wait_until(inflight > 0 && rq.due > now + 20000
+			    ? now + 20000 : rq.due);
+		}
+	}
+	free(reqs);
+	free(issued);
+	free(batch);
+	free(freeslots);
+}
+
+
+/*
+ * Reads with preadv2(RWF_NOWAIT): the reads which can be served from the
+ * pagecache are done inline, the others (EAGAIN) are punted to the pool of
+ * threads doing blocking reads, with up to "qdepth" reads in flight.
+ */
+void
+read_nowait(struct worker *w)
+{
+#ifdef RWF_NOWAIT
+	struct job	*j = w->job;
+	struct ofile	*of;
+	struct req	 rq, *reqs;
+	const struct req *done;
+	struct punt_io	*ios, *io;
+	struct iovec	 iov;
+	unsigned	*freeslots;
+	uint64_t	*issued;
+	size_t		*inlined;
+	unsigned	 nfree = j->qdepth, inflight = 0, s;
+	size_t		 toqueue = w->toread;
+	uint64_t	 t0, lat, due;
+	ssize_t		 nr;
+	int		 pending = 0;
+
+	freeslots = malloc(j->qdepth * sizeof(*freeslots));
+	issued = malloc(j->qdepth * sizeof(*issued));
+	inlined = malloc(j->qdepth * sizeof(*inlined));
+	reqs = malloc(j->qdepth * sizeof(*reqs));
+	ios = malloc(j->qdepth * sizeof(*ios));
+	if (freeslots == NULL || issued == NULL || inlined == NULL
+	    || reqs == NULL || ios == NULL)
+		error(1, errno, "Unable to allocate memory for %u slots",
+		    j->qdepth);
+	for (s = 0; s < j->qdepth; s++)
+		freeslots[s] = s;
+
+	while (toqueue > 0 || inflight > 0) {
+		while (toqueue > 0 && nfree > 0) {
+			if (!pending && !next_read(w, toqueue, &rq)) {
+				toqueue = 0;
+				break;
+			}
+			pending = 1;
+			if (rq.due > 0 && rq.due > now_ns())
+				break;
+			pending = 0;
+
+			of = get_file(w, rq.file);
+			if (j->classify)
+				rq.cls = classify(w, of, &rq);
+			s = freeslots[nfree - 1];
+			iov.iov_base = w->buffer + (size_t) s * j->maxbsize;
+			iov.iov_len = rq.bsize;
+			t0 = now_ns();
+			nr = preadv2(of->fd, &iov, 1, rq.offset, RWF_NOWAIT);
+			if (nr == -1 && errno != EAGAIN)
+				error(1, errno, errno == EOPNOTSUPP
+				    ? "RWF_NOWAIT not supported for '%s'"
+				    : "Error while reading '%s'",
+				    j->ds->files[rq.file].path);
+			toqueue -= rq.bsize < toqueue ? rq.bsize : toqueue;
+
+			if (j->record != NULL && trace_add(&w->rec,
+			    j->trace_ids[rq.file], rq.offset, rq.bsize,
+			    t0 - j->t_base) == -1)
+				error(1, errno, "Unable to allocate memory for "
+				    "the trace");
+
+			/*
+			 * A short read which does not end at EOF means that
+			 * only the head of the block is cached: the rest is
+			 * punted
+			 */
+			if (nr >= 0 && (size_t) nr < rq.bsize && rq.offset + nr
+			    < j->ds->files[rq.file].size)
+				inlined[s] = (size_t) nr;
+			else if (nr >= 0) {
+				/* Served from the pagecache */
+				lat = now_ns() - t0;
+				account_op(w, OP_READ, nr, lat);
+				account_op(w, OP_INLINE, nr, lat);
+				if (rq.cls != OP_READ)
+					account_op(w, rq.cls, nr, lat);
+				fdcache_put(&w->fc, rq.file);
+				continue;
+			} else
+				inlined[s] = 0;
+
+			nfree--;
+			io = &ios[s];
+			io->fd = of->fd;
+			io->buf = (char *) iov.iov_base + inlined[s];
+			io->len = rq.bsize - inlined[s];
+			io->offset = rq.offset + (off_t) inlined[s];
+			io->udata = s;
+			io->cq = &w->cq;
+			reqs[s] = rq;
+			issued[s] = t0;
+			punt_submit(j->punt, io);
+			inflight++;
+		}
+
+		/*
+		 * Blocks for the first completion only when nothing else to
+		 * do, reaps the completions until the next read is due if it
+		 * is pending with a free slot
+		 */
+		due = pending && nfree > 0 ? rq.due : 0;
+		while (inflight > 0 && (io = due > 0
+		    ? punt_reap_until(&w->cq, due)
+		    : punt_reap(&w->cq, nfree == 0 || toqueue == 0)) != NULL) {
+			s = (unsigned) io->udata;
+			done = &reqs[s];
+			if (io->res < 0)
+				error(1, (int) -io->res, "Error while reading "
+				    "'%s'", j->ds->files[done->file].path);
+
+			lat = io->t_done - issued[s];
+			nr = io->res + (ssize_t) inlined[s];
+			account_op(w, OP_READ, nr, lat);
+			account_op(w, OP_PUNTED, nr, lat);
+			account_op(w, OP_QUEUED, 0, io->t_started - io->t_queued);
+			if (done->cls != OP_READ)
+				account_op(w, done->cls, nr, lat);
+			fdcache_put(&w->fc, done->file);
+			freeslots[nfree++] = s;
+			inflight--;
+		}
+		if (due > 0)
+			wait_until(due);
+	}
+	free(ios);
+	free(reqs);
+	free(inlined);
+	free(issued);
+	free(freeslots);
+#else
+	(void) w;
+#endif /* RWF_NOWAIT */
+}
+
+
+void
+account(struct stats *st, ssize_t nbytes, uint64_t latency)
+{
+	st->nops++;
+	st->nbytes += (unsigned long long) nbytes;
+	hist_add(&st->lat, latency);
+}
+
+
+/* Accounts for an I/O of the thread, in the current interval as well */
+void
+account_op(struct worker *w, enum op op, ssize_t nbytes, uint64_t latency)
+{
+	account(&w->st[op], nbytes, latency);
+
+	if (w->job->interval > 0) {
+		pthread_mutex_lock(&w->lock);
+		account(&w->ist[op], nbytes, latency);
+		pthread_mutex_unlock(&w->lock);
+	}
+}
+
+
+/*
+ * Rate limit: the I/Os of the thread are scheduled at fixed times (from the
+ * number of I/Os or bytes issued so far), whatever the time they take, so
+ * that late I/Os do not shift the following ones.
+ */
+void
+pace(struct worker *w, struct req *rq)
+{
+	const struct job	*j = w->job;
+	double			 rate = j->rate / (double) j->nthreads;
+	double			 n;
+
+	n = j->rate_bytes ? (double) w->bissued : (double) w->nissued;
+	rq->due = j->t_base + w->phase + (uint64_t) (n * 1e9 / rate);
+
+	w->nissued++;
+	w->bissued += rq->bsize;
+}
+
+
+/*
+ * Collects (& resets) the interval stats of all the threads for the interval
+ * [prev:now], reports it or keeps it for the JSON output.
+ */
+void
+take_sample(struct job *j, struct worker *workers, uint64_t prev,
+    uint64_t now)
+{
+	struct stats	 agg[OP_COUNT];
+	struct sample	*sp;
+	int		 t, o;
+
+	for (o = 0; o < OP_COUNT; o++) {
+		memset(&agg[o], 0, sizeof(agg[o]));
+		hist_init(&agg[o].lat);
+	}
+
+	for (t = 0; t < j->nthreads; t++) {
+		struct worker *w = &workers[t];
+
+		pthread_mutex_lock(&w->lock);
+		for (o = 0; o < OP_COUNT; o++) {
+			agg[o].nops += w->ist[o].nops;
+			agg[o].nbytes += w->ist[o].nbytes;
+			hist_merge(&agg[o].lat, &w->ist[o].lat);
+			w->ist[o].nops = 0;
+			w->ist[o].nbytes = 0;
+			hist_init(&w->ist[o].lat);
+		}
+		pthread_mutex_unlock(&w->lock);
+	}
+
+	if (j->series->n == j->series->alloc) {
+		size_t n = j->series->alloc ? j->series->alloc * 2 : 64;
+
+		sp = realloc(j->series->samples, n * sizeof(*sp));
+		if (sp == NULL)
+			error(1, errno, "Unable to allocate memory for the "
+			    "interval reports");
+		j->series->samples = sp;
+		j->series->alloc = n;
+	}
+	sp = &j->series->samples[j->series->n++];
+	sp->t = (double) (now - j->t_base) / 1e9;
+	sp->length = (double) (now - prev) / 1e9;
+	for (o = 0; o < OP_COUNT; o++) {
+		sp->nops[o] = agg[o].nops;
+		sp->nbytes[o] = agg[o].nbytes;
+		sp->p50[o] = hist_percentile(&agg[o].lat, 50.0);
+		sp->p99[o] = hist_percentile(&agg[o].lat, 99.0);
+	}
+
+	if (!j->json) {
+		print_sample(j, sp);
+		fflush(stdout);
+	}
+}
+
+
+void
+print_sample(const struct job *j, const struct sample *sp)
+{
+	int o;
+
+	printf("[%8.3f s]", sp->t);
+	for (o = 0; o <= OP_WRITE; o++)
+		if (op_shown(j, o))
+			printf("%s %s: %.0f IOPS, %.2f MB/s, p50 %.1f us, "
+			    "p99 %.1f us", o > 0 ? "," : "", op_names[o],
+			    (double) sp->nops[o] / sp->length,
+			    (double) sp->nbytes[o] / sp->length / 1e6,
+			    (double) sp->p50[o] / 1e3,
+			    (double) sp->p99[o] / 1e3);
+	if (j->engine == ENGINE_NOWAIT)
+		printf(", inline: %.1f%%, punted p99 %.1f us",
+		    sp->nops[OP_READ] > 0 ? 100.0
+		    * (double) sp->nops[OP_INLINE]
+		    / (double) sp->nops[OP_READ] : 0.0,
+		    (double) sp->p99[OP_PUNTED] / 1e3);
+	if (j->classify)
+		printf(", hit ratio: %.1f%%, misses p99 %.1f us",
+		    sp->nops[OP_READ] > 0 ? 100.0 * (double) sp->nops[OP_HIT]
+		    / (double) sp->nops[OP_READ] : 0.0,
+		    (double) sp->p99[OP_MISS] / 1e3);
+	printf("\n");
 }
 
 
+void
+print_text(const char *label, enum op op, const struct stats *st,
+    double elapsed)
+{
+	const struct hist	*h = &st->lat;
+	double			 mbps = 0.0, iops = 0.0;
+
+	if (elapsed > 0.0) {
+		mbps = (double) st->nbytes / elapsed / 1e6;
+		iops = (double) st->nops / elapsed;
+	}
+	printf("%s: %llu bytes in %lu %s, %.3f s, %.2f MB/s, %.0f IOPS\n",
+	    label, st->nbytes, st->nops, op_names[op], elapsed, mbps, iops);
+
+	if (h->count == 0)
+		return;
+
+	printf("\tlatency (us): min %.1f, avg %.1f, p50 %.1f, p90 %.1f, "
+	    "p99 %.1f, p99.9 %.1f, max %.1f\n",
+	    (double) h->min / 1e3, hist_mean(h) / 1e3,
+	    (double) hist_percentile(h, 50.0) / 1e3,
+	    (double) hist_percentile(h, 90.0) / 1e3,
+	    (double) hist_percentile(h, 99.0) / 1e3,
+	    (double) hist_percentile(h, 99.9) / 1e3,
+	    (double) h->max / 1e3);
+}
+
+
+/* CPU time (& per GB of data read or written), faults & context switches */
+void
+print_cpu(const char *label, const struct cpustat *cs,
+    unsigned long long nbytes)
+{
+	printf("%s CPU: user %.3f s, sys %.3f s", label, cs->utime, cs->stime);
+	if (nbytes > 0)
+		printf(" (%.3f s/GB)", (cs->utime + cs->stime)
+		    / ((double) nbytes / 1e9));
+	printf(", faults: %ld minor, %ld major, context switches: %ld "
+	    "voluntary, %ld involuntary\n", cs->minflt, cs->majflt, cs->nvcsw,
+	    cs->nivcsw);
+
+	if (!cs->perf)
+		return;
+
+	printf("\tperf%s: %llu page faults (%llu major), cpu-clock %.3f s, "
+	    "%llu context switches\n", cs->user_only ? " (user space only)" : "",
+	    (unsigned long long) cs->counters[CPU_PAGE_FAULTS],
+	    (unsigned long long) cs->counters[CPU_MAJOR_FAULTS],
+	    (double) cs->counters[CPU_CLOCK] / 1e9,
+	    (unsigned long long) cs->counters[CPU_CONTEXT_SWITCHES]);
+}
+
+
+/*
+ * CPU usage of the read loops of all the threads (the 'nowait' pool threads
+ * & the kernel io_uring workers are not accounted for)
+ */
+void
+cpu_total(const struct job *job, const struct worker *workers,
+    struct cpustat *cpu)
+{
+	int t;
+
+	memset(cpu, 0, sizeof(*cpu));
+	cpu->perf = 1;
+	for (t = 0; t < job->nthreads; t++)
+		cpustat_add(cpu, &workers[t].cpu);
+}
+
+
+/* Throughput & latency object, without the enclosing braces */
+void
+print_json_stats(const struct stats *st, double elapsed)
+{
+	const struct hist	*h = &st->lat;
+	double			 mbps = 0.0, iops = 0.0;
+
+	if (elapsed > 0.0) {
+		mbps = (double) st->nbytes / elapsed / 1e6;
+		iops = (double) st->nops / elapsed;
+	}
+	printf("\"bytes\": %llu, \"ops\": %lu, \"elapsed_s\": %.6f, "
+	    "\"mbps\": %.3f, \"iops\": %.1f, \"latency_us\": { ",
+	    st->nbytes, st->nops, elapsed, mbps, iops);
+	print_json_lat(h);
+	printf(" }");
+}
+
+
+/* CPU usage object, without the enclosing braces */
+void
+print_json_cpu(const struct cpustat *cs, unsigned long long nbytes)
+{
+	int c;
+
+	printf("\"user_s\": %.6f, \"sys_s\": %.6f, \"s_per_gb\": %.6f, "
+	    "\"minor_faults\": %ld, \"major_faults\": %ld, "
+	    "\"voluntary_cs\": %ld, \"involuntary_cs\": %ld, \"perf\": ",
+	    cs->utime, cs->stime, nbytes > 0 ? (cs->utime + cs->stime)
+	    / ((double) nbytes / 1e9) : 0.0, cs->minflt, cs->majflt,
+	    cs->nvcsw, cs->nivcsw);
+	if (!cs->perf) {
+		printf("null");
+		return;
+	}
+	for (c = 0; c < CPU_NCOUNTERS; c++)
+		printf("%s\"%s\": %llu", c == 0 ? "{ " : ", ",
+		    cpu_counter_names[c], (unsigned long long) cs->counters[c]);
+	printf(", \"user_only\": %s }", cs->user_only ? "true" : "false");
+}
+
+
+void
+print_json_lat(const struct hist *h)
+{
+	printf("\"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+	    "\"p99\": %.3f, \"p99_9\": %.3f, \"max\": %.3f",
+	    h->count ? (double) h->min / 1e3 : 0.0, hist_mean(h) / 1e3,
+	    (double) hist_percentile(h, 50.0) / 1e3,
+	    (double) hist_percentile(h, 90.0) / 1e3,
+	    (double) hist_percentile(h, 99.0) / 1e3,
+	    (double) hist_percentile(h, 99.9) / 1e3,
+	    (double) h->max / 1e3);
+}
+
+
+void
+print_json(const struct job *j, const struct worker *workers,
+    const struct stats *total, double elapsed)
+{
+	const struct dsfile	*f = &j->ds->files[0];
+	const char		*c;
+	struct cpustat		 cpu;
+	size_t			 i;
+	int			 nthreads = j->nthreads, t, o;
+
+	printf("{\n  \"file\": \"");
+	for (c = f->path; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\')
+			putchar('\\');
+		if ((unsigned char) *c < 0x20)
+			printf("\\u%04x", (unsigned) *c);
+		else
+			putchar(*c);
+	}
+	printf("\", \"files\": %lu, \"bytes\": %llu,\n"
+	    "  \"engine\": \"%s\", \"qdepth\": %u, \"threads\": %d, "
+	    "\"pattern\": \"%s\", \"direct\": %s, \"madvise\": \"%s\",\n"
+	    "  \"seed\": %llu, \"pregenerated\": %s,\n"
+	    "  \"window\": [%llu, %llu], \"minbsize\": %lu, "
+	    "\"maxbsize\": %lu, \"alignment\": %llu,\n"
+	    "  \"write_pct\": %d, \"sync\": \"%s\", \"sync_every\": %u,\n"
+	    "  \"duration_s\": %.3f, \"rate\": %.1f, \"rate_unit\": \"%s\", "
+	    "\"interval_s\": %.3f,\n",
+	    (unsigned long) j->ds->nfiles, (unsigned long long) j->ds->length,
+	    engine_names[j->engine], j->qdepth, nthreads,
+	    j->replay != NULL ? (j->asap ? "replay (asap)" : "replay")
+	    : pattern_name(&j->pattern), j->direct ? "true" : "false",
+	    IS_MMAP_ENGINE(j->engine) ? j->advice->name : "",
+	    (unsigned long long) j->seed, j->pregen ? "true" : "false",
+	    (unsigned long long) f->start,
+	    (unsigned long long) (f->start + f->length),
+	    (unsigned long) j->minbsize, (unsigned long) j->maxbsize,
+	    (unsigned long long) j->alignment, j->wratio,
+	    sync_names[j->sync], j->sync_every, (double) j->duration / 1e9,
+	    j->rate_bytes ? j->rate / 1e6 : j->rate,
+	    j->rate_bytes ? "MB/s" : "IOPS", (double) j->interval / 1e9);
+
+	printf("  \"total\": { ");
+	print_json_stats(&total[OP_READ], elapsed);
+	for (o = OP_WRITE; o < OP_COUNT; o++) {
+		if (!op_shown(j, o))
+			continue;
+		printf(" },\n  \"total_%s\": { ", op_names[o]);
+		print_json_stats(&total[o], elapsed);
+	}
+	printf(" }");
+	if (j->classify)
+		printf(",\n  \"hit_ratio\": %.4f", total[OP_READ].nops > 0
+		    ? (double) total[OP_HIT].nops
+		    / (double) total[OP_READ].nops : 0.0);
+	if (j->engine == ENGINE_NOWAIT) {
+		printf(",\n  \"inline_ratio\": %.4f, "
+		    "\"punt_queue_latency_us\": { ", total[OP_READ].nops > 0
+		    ? (double) total[OP_INLINE].nops
+		    / (double) total[OP_READ].nops : 0.0);
+		print_json_lat(&total[OP_QUEUED].lat);
+		printf(" }");
+	}
+	cpu_total(j, workers, &cpu);
+	printf(",\n  \"cpu\": { ");
+	print_json_cpu(&cpu, total[OP_READ].nbytes + total[OP_WRITE].nbytes);
+	printf(" }");
+
+	printf(",\n  \"per_thread\": [\n");
+	for (t = 0; t < nthreads; t++) {
+		double telapsed = (double) (workers[t].t_end
+		    - workers[t].t_start) / 1e9;
+
+		printf("    { \"thread\": %d, ", t);
+		print_json_stats(&workers[t].st[OP_READ], telapsed);
+		for (o = OP_WRITE; o < OP_COUNT; o++) {
+			if (!op_shown(j, o))
+				continue;
+			printf(", \"%s\": { ", op_names[o]);
+			print_json_stats(&workers[t].st[o], telapsed);
+			printf(" }");
+		}
+		printf(", \"cpu\": { ");
+		print_json_cpu(&workers[t].cpu, workers[t].st[OP_READ].nbytes
+		    + workers[t].st[OP_WRITE].nbytes);
+		printf(" } }%s\n", t + 1 < nthreads ? "," : "");
+	}
+	printf("  ],\n  \"intervals\": [\n");
+	for (i = 0; i < j->series->n; i++) {
+		const struct sample *sp = &j->series->samples[i];
+
+		printf("    { \"t\": %.3f", sp->t);
+		if (j->classify)
+			printf(", \"hit_ratio\": %.4f", sp->nops[OP_READ] > 0
+			    ? (double) sp->nops[OP_HIT]
+			    / (double) sp->nops[OP_READ] : 0.0);
+		for (o = 0; o < OP_COUNT; o++) {
+			if (!op_shown(j, o))
+				continue;
+			printf(", \"%s\": { \"ops\": %lu, \"bytes\": %llu, "
+			    "\"iops\": %.1f, \"mbps\": %.3f, \"p50_us\": %.3f, "
+			    "\"p99_us\": %.3f }", op_names[o], sp->nops[o],
+			    sp->nbytes[o], (double) sp->nops[o] / sp->length,
+			    (double) sp->nbytes[o] / sp->length / 1e6,
+			    (double) sp->p50[o] / 1e3,
+			    (double) sp->p99[o] / 1e3);
+		}
+		printf(" }%s\n", i + 1 < j->series->n ? "," : "");
+	}
+	printf("  ]\n}\n");
+}
+
+
+void
+print_compare(enum op op, const struct stats *b, double belapsed,
+    const struct stats *d, double delapsed)
+{
+	const struct hist	*bh = &b->lat, *dh = &d->lat;
+
+	printf("%-18s %14s %14s\n", "", "buffered", "direct");
+	printf("%-18s %14llu %14llu\n", "bytes", b->nbytes, d->nbytes);
+	printf("%-18s %14lu %14lu\n", op_names[op], b->nops, d->nops);
+	printf("%-18s %14.3f %14.3f\n", "elapsed (s)", belapsed, delapsed);
+	printf("%-18s %14.2f %14.2f\n", "MB/s",
+	    belapsed > 0.0 ? (double) b->nbytes / belapsed / 1e6 : 0.0,
+	    delapsed > 0.0 ? (double) d->nbytes / delapsed / 1e6 : 0.0);
+	printf("%-18s %14.0f %14.0f\n", "IOPS",
+	    belapsed > 0.0 ? (double) b->nops / belapsed : 0.0,
+	    delapsed > 0.0 ? (double) d->nops / delapsed : 0.0);
+	printf("%-18s %14.1f %14.1f\n", "latency avg (us)",
+	    hist_mean(bh) / 1e3, hist_mean(dh) / 1e3);
+	printf("%-18s %14.1f %14.1f\n", "latency p50 (us)",
+	    (double) hist_percentile(bh, 50.0) / 1e3,
+	    (double) hist_percentile(dh, 50.0) / 1e3);
+	printf("%-18s %14.1f %14.1f\n", "latency p99 (us)",
+	    (double) hist_percentile(bh, 99.0) / 1e3,
+	    (double) hist_percentile(dh, 99.0) / 1e3);
+	printf("%-18s %14.1f %14.1f\n", "latency p99.9 (us)",
+	    (double) hist_percentile(bh, 99.9) / 1e3,
+	    (double) hist_percentile(dh, 99.9) / 1e3);
+	printf("%-18s %14.1f %14.1f\n", "latency max (us)",
+	    (double) bh->max / 1e3, (double) dh->max / 1e3);
+}
+
+
+void
+print_compare_cpu(const struct cpustat *b, unsigned long long bbytes,
+    const struct cpustat *d, unsigned long long dbytes)
+{
+	printf("%-18s %14s %14s\n", "", "buffered", "direct");
+	printf("%-18s %14.3f %14.3f\n", "CPU user (s)", b->utime, d->utime);
+	printf("%-18s %14.3f %14.3f\n", "CPU sys (s)", b->stime, d->stime);
+	printf("%-18s %14.3f %14.3f\n", "CPU (s/GB)", bbytes > 0
+	    ? (b->utime + b->stime) / ((double) bbytes / 1e9) : 0.0,
+	    dbytes > 0 ? (d->utime + d->stime) / ((double) dbytes / 1e9)
+	    : 0.0);
+	printf("%-18s %14ld %14ld\n", "minor faults", b->minflt, d->minflt);
+	printf("%-18s %14ld %14ld\n", "major faults", b->majflt, d->majflt);
+	printf("%-18s %14ld %14ld\n", "ctx switches", b->nvcsw + b->nivcsw,
+	    d->nvcsw + d->nivcsw);
+}
+
 
 int give_posix_hints(int fd, off_t start, size_t len)
 {
@@ -317,6 +2635,6 @@ int give_posix_hints(int fd, off_t start, size_t len)
 
 int prefetch(int fd, off_t start, size_t len)
 {
-	return readahead(fd, &start, len);
+	return readahead(fd, start, len);
 }
 
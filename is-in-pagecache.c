@@ -15,94 +15,262 @@
  *
  * is-in-pagecache: try to infer if the content of files is actually in
  * pagecache.
+ * Directories are scanned recursively by a pool of threads, with a summary
+ * per directory (of the files directly in it) & a grand total.
+ * cachestat() is used when available, with the dirty, writeback & evicted
+ * pages counts, else the files are checked with mincore().
  * All these files must be readable by the user.
  */
 
-#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "errwarn.h"
+#include "residency.h"
+#include "walk.h"
 
 const char progname[] = "is-in-pagecache";
 
+/* Files & pages, resident or not, extra counts from cachestat() */
+struct tally {
+	unsigned long long	 nfiles;
+	unsigned long long	 npages;
+	unsigned long long	 resident;
+	unsigned long long	 nstat;		/* files with extra counts */
+	struct residency_stat	 extra;
+};
+
+struct scan {
+	long int		 pagesize;
+	int			 verbose;
+	int			 cachestat;	/* still tried */
+	pthread_mutex_t		 lock;		/* for 'total' */
+	struct tally		 total;
+	unsigned long long	 ndirs;
+};
+
+void usage(FILE *);
+void *dir_enter(void *, const char *);
+void dir_file(void *, void *, const char *, int, const struct stat *);
+void dir_leave(void *, void *, const char *);
+void tally_add(struct tally *, const struct tally *);
+const char *format_extra(const struct tally *, char *, size_t);
+double percent(unsigned long long, unsigned long long);
+
+void usage(FILE *fp)
+{
+	fprintf(fp,
+"\nTells how much of the content of files is in the pagecache.\n"
+"\nUsage:\n"
+"%s [-j threads] [-M] [-v] file|directory ...\n"
+"\nWhere:\n"
+" -j threads: number of threads scanning the directories, default is the\n"
+"    number of online processors.\n"
+" -M always uses mincore(), even if cachestat() is available (the dirty,\n"
+"    writeback & evicted pages are then not reported).\n"
+" -v reports every file found in the directories, not only the summary of\n"
+"    each directory.\n"
+"\nThe files given are reported one by one, directories are scanned\n"
+"recursively (symbolic links in the directories are not followed).\n", progname);
+}
+
+
 int main(int argc, char *argv[])
 {
-	struct stat	 st;
-	void		*filemap = NULL;
-#ifdef __linux__
-	unsigned char	*vec = NULL;
-#else
-	char		*vec = NULL;
-#endif
-	size_t		 vlen;
-	unsigned long	 pim, k;
-	long int	 pagesize;
-	int		 i, fd;
-
-	pagesize = sysconf(_SC_PAGESIZE);
-	if (pagesize == -1)
+	struct walk_ops	 ops = { dir_enter, dir_file, dir_leave };
+	struct scan	 sc;
+	char		 extra[128];
+	long int	 nthreads;
+	int		 ch, rc;
+
+	memset(&sc, 0, sizeof(sc));
+	sc.cachestat = 1;
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1)
+		nthreads = 1;
+
+	while ((ch = getopt(argc, argv, ":hj:Mv")) != -1) {
+		switch (ch) {
+		case 'h':
+			usage(stdout);
+			exit(0);
+		case 'j':
+			nthreads = atol(optarg);
+			if (nthreads < 1 || nthreads > 1024)
+				error(1, -1, "Invalid number of threads: '%s'",
+				    optarg);
+			break;
+		case 'M':
+			sc.cachestat = 0;
+			break;
+		case 'v':
+			sc.verbose = 1;
+			break;
+		case ':':
+			usage(stderr);
+			error(1, -1, "Option -%c requires an argument", optopt);
+			break;
+		default:
+			usage(stderr);
+			error(1, -1, "Unknown option: -%c", optopt);
+			break;
+		}
+	}
+	if (optind == argc) {
+		usage(stderr);
+		exit(1);
+	}
+
+	sc.pagesize = sysconf(_SC_PAGESIZE);
+	if (sc.pagesize == -1)
 		error(1, errno, "Unable to get pagesize");
 	else
-		printf("Pagesize is: %ld bytes.\n", pagesize);
-
-	for (i = 1; i < argc; i++) {
-		fd = open(argv[i], O_RDONLY);
-		if (fd != -1) {
-			if (fstat(fd, &st) == -1) {
-				warning(errno, "Unable to stat '%s'", argv[i]);
-				continue;
-			}
-			if (st.st_size > 0) {
-				filemap = (unsigned char*) mmap(NULL, st.st_size,
-				    PROT_READ, MAP_SHARED, fd, 0);
-				if (filemap == MAP_FAILED) {
-					warning(errno, "Unable to map '%s'",
-					    argv[i]);
-					continue;
-				}
-
-				vlen = (st.st_size + pagesize - 1) / pagesize;
-				vec = malloc(vlen);
-				if (vec == NULL)
-					error(2, errno, "Unable to allocate "
-					    "vec[%lu]", (unsigned long) vlen);
-
-				if (mincore(filemap, st.st_size, vec) == -1) {
-					warning(errno, "Unable to get core info"
-					    " for '%s'", argv[i]);
-					continue;
-				}
-				pim = 0;
-				for (k = 0; k < vlen; k++) {
-					if (vec[k] & 1)
-						pim++;
-				}
-				printf("'%s': %lu pages out of %lu appear to be"
-				    " in pagecache\n", argv[i], pim,
-				    (unsigned long) vlen);
-
-				free(vec);
-				vec = NULL;
-
-				if (munmap(filemap, st.st_size) == -1) {
-					warning(errno, "Unable to unmap '%s'",
-					    argv[i]);
-					continue;
-				}
-			}
-			if (close(fd) == -1)
-				warning(errno, "Problem closing '%s'", argv[i]);
-		} else {
-			warning(errno, "Unable to open '%s'", argv[i]);
-		}
+		printf("Pagesize is: %ld bytes.\n", sc.pagesize);
+	pthread_mutex_init(&sc.lock, NULL);
+
+	rc = walk((const char *const *) argv + optind, argc - optind,
+	    (int) nthreads, &ops, &sc);
+	if (rc != 0)
+		error(2, rc, "Unable to scan the files");
+
+	if (sc.ndirs > 0 || argc - optind > 1) {
+		printf("Total: %llu files in %llu directories, %llu pages "
+		    "out of %llu (%.2f%%) appear to be in pagecache%s\n",
+		    sc.total.nfiles, sc.ndirs, sc.total.resident,
+		    sc.total.npages, percent(sc.total.resident,
+		    sc.total.npages), format_extra(&sc.total, extra,
+		    sizeof(extra)));
 	}
+	pthread_mutex_destroy(&sc.lock);
+
 	return (0);
 }
 
+
+/* The tally of the files directly in the directory */
+void *
+dir_enter(void *arg, const char *path)
+{
+	struct tally *t;
+
+	(void) arg;
+	(void) path;
+
+	t = calloc(1, sizeof(*t));
+	if (t == NULL)
+		error(2, errno, "Unable to allocate memory");
+
+	return (t);
+}
+
+
+void
+dir_file(void *arg, void *dir, const char *path, int fd,
+    const struct stat *st)
+{
+	struct scan		*sc = arg;
+	struct tally		*t = dir, f;
+	struct residency	 r;
+	char			 extra[128];
+
+	memset(&f, 0, sizeof(f));
+	f.nfiles = 1;
+	f.npages = (unsigned long long) ((st->st_size + sc->pagesize - 1)
+	    / sc->pagesize);
+
+	/* cachestat() is no longer tried once known to be unavailable */
+	if (__atomic_load_n(&sc->cachestat, __ATOMIC_RELAXED)) {
+		if (residency_stat(fd, 0, 0, &f.extra) == 0) {
+			f.resident = f.extra.cached;
+			f.nstat = 1;
+		} else if (errno == ENOSYS || errno == EOPNOTSUPP)
+			__atomic_store_n(&sc->cachestat, 0, __ATOMIC_RELAXED);
+	}
+	if (f.nstat == 0 && (residency_init(&r) == -1
+	    || residency_count(&r, fd, st->st_size, &f.resident) == -1)) {
+		warning(errno, "Unable to get core info for '%s'", path);
+		return;
+	}
+
+	/* Files given as such are always reported */
+	if (t == NULL || sc->verbose)
+		printf("'%s': %llu pages out of %llu appear to be in "
+		    "pagecache%s\n", path, f.resident, f.npages,
+		    format_extra(&f, extra, sizeof(extra)));
+
+	if (t != NULL) {
+		tally_add(t, &f);
+		return;
+	}
+	pthread_mutex_lock(&sc->lock);
+	tally_add(&sc->total, &f);
+	pthread_mutex_unlock(&sc->lock);
+}
+
+
+void
+dir_leave(void *arg, void *dir, const char *path)
+{
+	struct scan	*sc = arg;
+	struct tally	*t = dir;
+	char		 extra[128];
+
+	if (t->nfiles > 0)
+		printf("'%s/': %llu files, %llu pages out of %llu (%.2f%%) "
+		    "appear to be in pagecache%s\n", path, t->nfiles,
+		    t->resident, t->npages, percent(t->resident, t->npages),
+		    format_extra(t, extra, sizeof(extra)));
+
+	pthread_mutex_lock(&sc->lock);
+	sc->ndirs++;
+	tally_add(&sc->total, t);
+	pthread_mutex_unlock(&sc->lock);
+	free(t);
+}
+
+
+void
+tally_add(struct tally *t, const struct tally *o)
+{
+	t->nfiles += o->nfiles;
+	t->npages += o->npages;
+	t->resident += o->resident;
+	t->nstat += o->nstat;
+	t->extra.cached += o->extra.cached;
+	t->extra.dirty += o->extra.dirty;
+	t->extra.writeback += o->extra.writeback;
+	t->extra.evicted += o->extra.evicted;
+	t->extra.recently_evicted += o->extra.recently_evicted;
+}
+
+
+/*
+ * The extra counts from cachestat() (if any) in 'buf', to be displayed with
+ * the rest of the line in a single printf() (the threads share stdout).
+ */
+const char *
+format_extra(const struct tally *t, char *buf, size_t size)
+{
+	buf[0] = '\0';
+	if (t->nstat > 0)
+		snprintf(buf, size, ", %llu dirty, %llu under writeback, "
+		    "%llu evicted (%llu recently)", t->extra.dirty,
+		    t->extra.writeback, t->extra.evicted,
+		    t->extra.recently_evicted);
+
+	return (buf);
+}
+
+
+double
+percent(unsigned long long part, unsigned long long whole)
+{
+	return (whole > 0 ? 100.0 * (double) part / (double) whole : 0.0);
+}
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Access pattern generators.  A pattern is described by a string:
+ *	uniform			uniformly random positions (the default)
+ *	seq			sequential
+ *	rev			sequential, backwards
+ *	stride:bytes		fixed stride between the start of the accesses
+ *	zipf:theta		the window is split in records, the popularity
+ *				of the records follows a Zipf law (0 < theta <
+ *				1), the most popular records at the start
+ *	hotspot:x:y		x% of the accesses go to the first y% of the
+ *				window, the others to the rest of the window
+ * The sequential patterns keep a per-caller cursor & wrap around.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pattern.h"
+#include "rng.h"
+
+static const char *pattern_names[PATTERN_COUNT] = {
+	"uniform", "seq", "rev", "stride", "zipf", "hotspot"
+};
+
+/* Number of terms of the zeta function summed exactly */
+static const uint64_t zeta_exact_terms = 1000000;
+
+static double zeta(uint64_t, double);
+
+
+/* Returns 0 on success, -1 with errno set to EINVAL on a malformed string */
+int
+pattern_parse(struct pattern *p, const char *s)
+{
+	const char	*arg = strchr(s, ':');
+	size_t		 nlen = arg != NULL ? (size_t) (arg - s) : strlen(s);
+	char		*end = NULL;
+	int		 k;
+
+	memset(p, 0, sizeof(*p));
+
+	for (k = 0; k < PATTERN_COUNT; k++) {
+		if (strlen(pattern_names[k]) == nlen
+		    && strncmp(s, pattern_names[k], nlen) == 0)
+			break;
+	}
+	if (k == PATTERN_COUNT)
+		goto invalid;
+	p->kind = (enum pattern_kind) k;
+
+	switch (p->kind) {
+	case PATTERN_STRIDE:
+		if (arg == NULL)
+			goto invalid;
+		p->stride = (off_t) strtoll(arg + 1, &end, 10);
+		if (*end != '\0' || p->stride <= 0)
+			goto invalid;
+		break;
+	case PATTERN_ZIPF:
+		if (arg == NULL)
+			goto invalid;
+		p->theta = strtod(arg + 1, &end);
+		if (*end != '\0' || p->theta <= 0.0 || p->theta >= 1.0)
+			goto invalid;
+		break;
+	case PATTERN_HOTSPOT:
+		if (arg == NULL)
+			goto invalid;
+		p->hot_ops = strtod(arg + 1, &end) / 100.0;
+		if (*end != ':')
+			goto invalid;
+		p->hot_space = strtod(end + 1, &end) / 100.0;
+		if (*end != '\0' || p->hot_ops < 0.0 || p->hot_ops > 1.0
+		    || p->hot_space <= 0.0 || p->hot_space >= 1.0)
+			goto invalid;
+		break;
+	default:
+		if (arg != NULL)
+			goto invalid;
+		break;
+	}
+
+	return (0);
+
+invalid:
+	errno = EINVAL;
+
+	return (-1);
+}
+
+
+/*
+ * Prepares the pattern for a 'length' bytes window, 'record' is the zipfian
+ * record size.
+ */
+void
+pattern_setup(struct pattern *p, off_t length, off_t record)
+{
+	double zeta2;
+
+	p->length = length;
+
+	if (p->kind != PATTERN_ZIPF)
+		return;
+
+	/* See Gray et al., "Quickly generating billion-record synthetic
+	 * databases", SIGMOD 1994.
+	 */
+	p->record = record > 0 ? record : 1;
+	p->nrecords = (uint64_t) (length / p->record);
+	if (p->nrecords < 2)
+		p->nrecords = 2;
+	zeta2 = zeta(2, p->theta);
+	p->zetan = zeta(p->nrecords, p->theta);
+	p->alpha = 1.0 / (1.0 - p->theta);
+	p->eta = (1.0 - pow(2.0 / (double) p->nrecords, 1.0 - p->theta))
+	    / (1.0 - zeta2 / p->zetan);
+}
+
+
+const char *
+pattern_name(const struct pattern *p)
+{
+	return (pattern_names[p->kind]);
+}
+
+
+/*
+ * Random patterns are free to pick any position, the others follow a
+ * cursor.
+ */
+int
+pattern_is_random(const struct pattern *p)
+{
+	return (p->kind == PATTERN_UNIFORM || p->kind == PATTERN_ZIPF
+	    || p->kind == PATTERN_HOTSPOT);
+}
+
+
+/*
+ * Initial cursor for caller 'id' out of 'n': sequential callers start
+ * evenly spread over the window so that they do not read the same data.
+ */
+off_t
+pattern_start(const struct pattern *p, int id, int n)
+{
+	double share = (double) p->length / (double) n;
+
+	if (p->kind == PATTERN_REV)
+		return ((off_t) (share * (id + 1)));
+
+	return ((off_t) (share * id));
+}
+
+
+/*
+ * Returns the position (in [0:length)) of the next access of 'size' bytes,
+ * updating the cursor for the non random patterns.
+ */
+off_t
+pattern_next(const struct pattern *p, off_t *cursor, size_t size,
+    struct rng *rng)
+{
+	off_t		 pos, len = p->length, sz = (off_t) size;
+	off_t		 hot;
+	uint64_t	 rec;
+	double		 u, uz;
+
+	switch (p->kind) {
+	case PATTERN_SEQ:
+	case PATTERN_STRIDE:
+		if (*cursor >= len || *cursor + sz > len)
+			*cursor = 0;
+		pos = *cursor;
+		*cursor += p->kind == PATTERN_SEQ ? sz : p->stride;
+		break;
+	case PATTERN_REV:
+		if (*cursor < sz || *cursor > len)
+			*cursor = len;
+		*cursor -= sz;
+		if (*cursor < 0)
+			*cursor = 0;
+		pos = *cursor;
+		break;
+	case PATTERN_ZIPF:
+		u = rng_unit(rng);
+		uz = u * p->zetan;
+		if (uz < 1.0)
+			rec = 0;
+		else if (uz < 1.0 + pow(0.5, p->theta))
+			rec = 1;
+		else
+			rec = (uint64_t) ((double) p->nrecords
+			    * pow(p->eta * u - p->eta + 1.0, p->alpha));
+		if (rec >= p->nrecords)
+			rec = p->nrecords - 1;
+		pos = (off_t) rec * p->record;
+		break;
+	case PATTERN_HOTSPOT:
+		/* At least one hot & one cold position */
+		if (len <= 1) {
+			pos = 0;
+			break;
+		}
+		hot = (off_t) ((double) len * p->hot_space);
+		if (hot < 1)
+			hot = 1;
+		else if (hot > len - 1)
+			hot = len - 1;
+		if (rng_unit(rng) < p->hot_ops)
+			pos = (off_t) rng_below(rng, (uint64_t) hot);
+		else
+			pos = hot + (off_t) rng_below(rng,
+			    (uint64_t) (len - hot));
+		break;
+	case PATTERN_UNIFORM:
+	default:
+		pos = (off_t) rng_below(rng, (uint64_t) len);
+		break;
+	}
+
+	return (pos);
+}
+
+
+/*
+ * sum(1/i^theta, i = 1..n), the terms past the first million are
+ * approximated with the integral of x^-theta (midpoint rule).
+ */
+double
+zeta(uint64_t n, double theta)
+{
+	uint64_t	 i, exact = n < zeta_exact_terms ? n : zeta_exact_terms;
+	double		 sum = 0.0, a, b;
+
+	for (i = 1; i <= exact; i++)
+		sum += pow((double) i, -theta);
+
+	if (n > exact) {
+		a = (double) exact + 0.5;
+		b = (double) n + 0.5;
+		sum += (pow(b, 1.0 - theta) - pow(a, 1.0 - theta))
+		    / (1.0 - theta);
+	}
+
+	return (sum);
+}
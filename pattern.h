@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Access pattern generators: positions in a [0:length) window.
+ */
+
+#ifndef __PATTERN_H__
+#define __PATTERN_H__
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+struct rng;
+
+enum pattern_kind {
+	PATTERN_UNIFORM,	/* uniformly random */
+	PATTERN_SEQ,		/* sequential, wraps at the end */
+	PATTERN_REV,		/* sequential backwards, wraps at the start */
+	PATTERN_STRIDE,		/* fixed stride, wraps at the end */
+	PATTERN_ZIPF,		/* zipfian record popularity */
+	PATTERN_HOTSPOT,	/* x% of the accesses in y% of the window */
+	PATTERN_COUNT
+};
+
+struct pattern {
+	enum pattern_kind	 kind;
+	off_t			 length;
+	off_t			 stride;
+	/* zipf */
+	double			 theta;
+	off_t			 record;
+	uint64_t		 nrecords;
+	double			 zetan;
+	double			 alpha;
+	double			 eta;
+	/* hotspot, as fractions */
+	double			 hot_ops;
+	double			 hot_space;
+};
+
+extern int pattern_parse(struct pattern *, const char *);
+extern void pattern_setup(struct pattern *, off_t, off_t);
+extern const char *pattern_name(const struct pattern *);
+extern int pattern_is_random(const struct pattern *);
+extern off_t pattern_start(const struct pattern *, int, int);
+extern off_t pattern_next(const struct pattern *, off_t *, size_t,
+    struct rng *);
+
+#endif /* __PATTERN_H__ */
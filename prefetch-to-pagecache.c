@@ -16,44 +16,700 @@
  * prefetch-to-pagecache: give hints to the pagecache to prefetch the content
  * of the files which names are given on the command line.
  * All these files must be readable by the user.
- * This is a hint given to the pagecache which is free to ignore it.
+ * This is a hint given to the pagecache which is free to ignore it, unless
+ * the files are prefetched with readahead() (which returns once the reads
+ * are started) or actually read.
+ * Directories are scanned recursively, the files are then prefetched by a
+ * pool of threads (a part of each file if a range is given) until the
+ * free memory would drop below a threshold.
+ * Alternatively, the files can be pinned (mapped & locked) in memory up to
+ * a total size, in the order given, until the process is terminated.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE	/* readahead() */
+#endif /* __linux__ */
+
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "errwarn.h"
+#include "residency.h"
+#include "util.h"
+#include "walk.h"
+
+/* Bytes prefetched at once */
+#define PREFETCH_CHUNK	(1 << 20)
+/* Bytes prefetched (by all the threads) between two reads of /proc/meminfo */
+#define MEMINFO_EVERY	(64ULL << 20)
 
 const char progname[] = "prefetch-to-pagecache";
 
+/* How the files are prefetched, in the same order as method_names[] */
+enum method {
+	METHOD_HINT,		/* posix_fadvise(POSIX_FADV_WILLNEED) */
+	METHOD_READAHEAD,	/* readahead() */
+	METHOD_READ,		/* pread() */
+	METHOD_COUNT
+};
+const char	*method_names[METHOD_COUNT] = { "hint", "readahead", "read" };
+
+/* Set by SIGTERM, SIGINT or SIGHUP, the pinned files are then released */
+volatile sig_atomic_t	 released;
+
+struct pfile {
+	char			*path;
+	unsigned long long	 size;
+};
+
+/* A range of a file, mapped & locked in memory */
+struct pin {
+	const char		*path;
+	int			 fd;
+	void			*addr;
+	size_t			 len;
+	off_t			 offset;
+};
+
+struct prefetch {
+	enum method		 method;
+	unsigned long long	 offset;	/* range of each file */
+	unsigned long long	 length;	/* 0 up to the end */
+	unsigned long long	 keep;		/* bytes left free */
+	int			 verbose;
+	pthread_mutex_t		 lock;		/* for the following */
+	struct pfile		*files;
+	size_t			 nfiles;
+	size_t			 alloc;
+	int			 stop;		/* memory budget exhausted */
+	unsigned long long	 avail;		/* MemFree when read */
+	unsigned long long	 since;		/* bytes since then */
+	size_t			 next;		/* file, atomic */
+	int			 nrunning;	/* threads, atomic */
+	uint64_t		 t_end;		/* ns, by the last thread */
+	unsigned long long	 nbytes;	/* atomic */
+	unsigned long long	 ndone;		/* files, atomic */
+};
+
+void usage(FILE *);
+enum method parse_method(const char *);
+int mem_free(unsigned long long *);
+void add_file(void *, void *, const char *, int, const struct stat *);
+int reserve(struct prefetch *, unsigned long long);
+int prefetch_chunk(struct prefetch *, int, char *, unsigned long long,
+    unsigned long long);
+void prefetch_file(struct prefetch *, const struct pfile *, char *);
+void *prefetcher(void *);
+void report(const struct prefetch *, double, FILE *, const char *);
+int pathcmp(const void *, const void *);
+void on_signal(int);
+int pin_file(const struct prefetch *, const struct pfile *, unsigned long long,
+    long int, struct pin *);
+unsigned long long check_pin(struct residency *, const struct pin *);
+void pin_files(struct prefetch *, unsigned long long, unsigned int, int);
+void prefetch_files(struct prefetch *, int, int);
+
+void usage(FILE *fp)
+{
+	fprintf(fp,
+"\nPrefetches the content of files to the pagecache.\n"
+"\nUsage:\n"
+"%s [-j threads] [-k size] [-m method] [-O offset] [-L length] [-p] [-v]\n"
+"    file|directory ...\n"
+"%s -P size [-i interval] [-O offset] [-L length] [-p] [-v]\n"
+"    file|directory ...\n"
+"\nWhere:\n"
+" -i interval: seconds between two checks of the pinned files (60 by\n"
+"    default).\n"
+" -j threads: number of threads prefetching files, default is the number of\n"
+"    online processors.\n"
+" -k size: stops before the free memory (MemFree, not used by the pagecache\n"
+"    either) drops below size.\n"
+" -m method: 'hint' (posix_fadvise(), the default), 'readahead' (returns\n"
+"    once the reads are started) or 'read' (returns once the content is in\n"
+"    the pagecache).\n"
+" -O offset: prefetches each file from offset.\n"
+" -L length: prefetches at most length bytes of each file.\n"
+" -P size: pins (locks in memory) the files, in the order given, up to size\n"
+"    in total, then checks them periodically until terminated.\n"
+" -p reports the progress every second (or the result of every check of\n"
+"    the pinned files) on the standard error.\n"
+" -v reports every file prefetched (or pinned).\n"
+"\nSizes, offsets & lengths in bytes, or with a K, M, G or T suffix.\n"
+"Directories are scanned recursively (symbolic links in the directories are\n"
+"not followed), their files in path order.\n",
+	    progname, progname);
+}
+
+
 int main(int argc, char *argv[])
 {
-	struct stat st;
-	int i, fd;
+	struct walk_ops		 ops = { NULL, add_file, NULL };
+	struct prefetch		 pf;
+	long int		 nthreads;
+	unsigned long long	 cap = 0;
+	unsigned int		 interval = 60;
+	size_t			 i, first;
+	int			 ch, rc, progress = 0;
 
-	for (i = 1; i < argc; i++) {
-		fd = open(argv[i], O_RDONLY);
-		if (fd != -1) {
-			if (fstat(fd, &st) == -1) {
-				warning(errno, "Unable to stat '%s'", argv[i]);
-				continue;
-			}
-			if (st.st_size > 0 && posix_fadvise(fd, 0, st.st_size,
-			    POSIX_FADV_WILLNEED) != 0) {
-				warning(errno, "Unable to give cache hint for "
-				    "'%s'", argv[i]);
-				continue;
-			}
-			if (close(fd) == -1)
-				warning(errno, "Problem closing '%s'", argv[i]);
-		} else
-			warning(errno, "Unable to open '%s'", argv[i]);
+	memset(&pf, 0, sizeof(pf));
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1)
+		nthreads = 1;
+
+	while ((ch = getopt(argc, argv, ":hi:j:k:L:m:O:pP:v")) != -1) {
+		switch (ch) {
+		case 'h':
+			usage(stdout);
+			exit(0);
+		case 'i':
+			interval = (unsigned int) atoi(optarg);
+			if (interval == 0)
+				error(1, -1, "Invalid interval: '%s'", optarg);
+			break;
+		case 'j':
+			nthreads = atol(optarg);
+			if (nthreads < 1 || nthreads > 1024)
+				error(1, -1, "Invalid number of threads: '%s'",
+				    optarg);
+			break;
+		case 'k':
+			pf.keep = parse_size(optarg);
+			break;
+		case 'L':
+			pf.length = parse_size(optarg);
+			break;
+		case 'm':
+			pf.method = parse_method(optarg);
+			break;
+		case 'O':
+			pf.offset = parse_size(optarg);
+			break;
+		case 'p':
+			progress = 1;
+			break;
+		case 'P':
+			cap = parse_size(optarg);
+			if (cap == 0)
+				error(1, -1, "Invalid size: '%s'", optarg);
+			break;
+		case 'v':
+			pf.verbose = 1;
+			break;
+		case ':':
+			usage(stderr);
+			error(1, -1, "Option -%c requires an argument", optopt);
+			break;
+		default:
+			usage(stderr);
+			error(1, -1, "Unknown option: -%c", optopt);
+			break;
+		}
+	}
+	if (optind == argc) {
+		usage(stderr);
+		exit(1);
+	}
+	if (cap > 0 && (pf.keep > 0 || pf.method != METHOD_HINT))
+		error(1, -1, "-k & -m do not apply to pinned files");
+	if (pf.keep > 0 && mem_free(&pf.avail) == -1)
+		error(1, errno, "Unable to get the free memory");
+	pthread_mutex_init(&pf.lock, NULL);
+
+	/*
+	 * The files first, in the order given (& path order for those in
+	 * directories), their content is then spread over the threads.
+	 */
+	for (; optind < argc; optind++) {
+		first = pf.nfiles;
+		rc = walk((const char *const *) argv + optind, 1,
+		    (int) nthreads, &ops, &pf);
+		if (rc != 0)
+			error(2, rc, "Unable to scan the files");
+		qsort(pf.files + first, pf.nfiles - first, sizeof(*pf.files),
+		    pathcmp);
+	}
+	if (cap > 0)
+		pin_files(&pf, cap, interval, progress);
+	else
+		prefetch_files(&pf, (int) nthreads, progress);
+
+	for (i = 0; i < pf.nfiles; i++)
+		free(pf.files[i].path);
+	free(pf.files);
+	pthread_mutex_destroy(&pf.lock);
+
+	return (0);
+}
+
+
+/* Prefetches the files with a pool of threads */
+void
+prefetch_files(struct prefetch *pf, int nthreads, int progress)
+{
+	struct timespec	 ts;
+	pthread_t	*tids;
+	uint64_t	 t0;
+	int		 t, rc, tick;
+
+	if ((size_t) nthreads > pf->nfiles)
+		nthreads = pf->nfiles > 0 ? (int) pf->nfiles : 1;
+	tids = calloc((size_t) nthreads, sizeof(*tids));
+	if (tids == NULL)
+		error(2, errno, "Unable to allocate memory");
+
+	t0 = now_ns();
+	pf->nrunning = nthreads;
+	for (t = 0; t < nthreads; t++) {
+		rc = pthread_create(&tids[t], NULL, prefetcher, pf);
+		if (rc != 0)
+			error(2, rc, "Unable to create thread %d", t);
+	}
+	/* Every second, checking for the end every 100 ms */
+	for (tick = 1; progress && __atomic_load_n(&pf->nrunning,
+	    __ATOMIC_ACQUIRE) > 0; tick++) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 100000000;
+		nanosleep(&ts, NULL);
+		if (tick % 10 == 0)
+			report(pf, (double) (now_ns() - t0) / 1e9, stderr,
+			    "");
+	}
+	for (t = 0; t < nthreads; t++)
+		pthread_join(tids[t], NULL);
+	free(tids);
+
+	report(pf, (double) (pf->t_end - t0) / 1e9, stdout, "Prefetched ");
+	if (pf->stop)
+		printf("Stopped before the free memory drops below %llu "
+		    "MB (%llu files left).\n", pf->keep >> 20,
+		    (unsigned long long) (pf->nfiles - pf->ndone));
+}
+
+
+/*
+ * Maps & locks the range of 'f' (up to 'left' bytes) in memory, returns 0,
+ * 1 if there is nothing to pin or -1 with errno set.
+ */
+int
+pin_file(const struct prefetch *pf, const struct pfile *f,
+    unsigned long long left, long int pagesize, struct pin *p)
+{
+	unsigned long long	 pgsz = (unsigned long long) pagesize;
+	unsigned long long	 off, end;
+	int			 serrno;
+
+	memset(p, 0, sizeof(*p));
+	off = pf->offset / pgsz * pgsz;
+	end = pf->length > 0 && pf->length < f->size - pf->offset
+	    ? pf->offset + pf->length : f->size;
+	if (end - off > left)
+		end = off + left / pgsz * pgsz;
+	if (end <= off)
+		return (1);
+
+	p->path = f->path;
+	p->offset = (off_t) off;
+	p->len = (size_t) (end - off);
+	p->fd = open(f->path, O_RDONLY);
+	if (p->fd == -1)
+		return (-1);
+	p->addr = mmap(NULL, p->len, PROT_READ, MAP_SHARED, p->fd, p->offset);
+	if (p->addr == MAP_FAILED) {
+		serrno = errno;
+		close(p->fd);
+		errno = serrno;
+		return (-1);
+	}
+	/* Reads whatever is not in the pagecache yet */
+	if (mlock(p->addr, p->len) == -1) {
+		serrno = errno;
+		munmap(p->addr, p->len);
+		close(p->fd);
+		errno = serrno;
+		return (-1);
 	}
+
 	return (0);
 }
 
+
+/* Pages of the pinned range which are not (or no longer) resident */
+unsigned long long
+check_pin(struct residency *r, const struct pin *p)
+{
+	unsigned long long	 missing = 0;
+	size_t			 done, n, pgsz = (size_t) r->pagesize;
+
+	for (done = 0; done < p->len; done += n * pgsz) {
+		n = (p->len - done + pgsz - 1) / pgsz;
+		if (n > RESIDENCY_PAGES)
+			n = RESIDENCY_PAGES;
+		if (mincore((char *) p->addr + done, n * pgsz, r->vec) == -1)
+			missing += n;
+		else
+			missing += n - r->kernel->count(r->vec, n);
+	}
+
+	return (missing);
+}
+
+
+void
+on_signal(int sig)
+{
+	(void) sig;
+
+	released = 1;
+}
+
+
+/*
+ * Pins the files in order until 'cap' bytes are locked, then checks them
+ * every 'interval' seconds (locking again what was lost, e.g. after a file
+ * was truncated & extended) until a signal is received.
+ */
+void
+pin_files(struct prefetch *pf, unsigned long long cap, unsigned int interval,
+    int progress)
+{
+	struct sigaction	 sa;
+	struct residency	 r;
+	struct timespec		 ts;
+	struct rlimit		 rl;
+	struct pin		*pins;
+	unsigned long long	 pinned = 0, missing, lost;
+	size_t			 i, npins = 0;
+	int			 rc;
+
+	if (residency_init(&r) == -1)
+		error(1, errno, "Unable to get pagesize");
+	pins = calloc(pf->nfiles > 0 ? pf->nfiles : 1, sizeof(*pins));
+	if (pins == NULL)
+		error(2, errno, "Unable to allocate memory");
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+
+	/* As much as allowed, the cap is enforced here */
+	if (getrlimit(RLIMIT_MEMLOCK, &rl) == 0 && rl.rlim_cur != rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_MEMLOCK, &rl);
+	}
+
+	for (i = 0; i < pf->nfiles && pinned < cap && !released; i++) {
+		rc = pin_file(pf, &pf->files[i], cap - pinned, r.pagesize,
+		    &pins[npins]);
+		if (rc == 1)
+			continue;
+		if (rc == -1) {
+			warning(errno, "Unable to pin '%s'",
+			    pf->files[i].path);
+			if (errno == ENOMEM || errno == EAGAIN || errno == EPERM)
+				break;	/* RLIMIT_MEMLOCK reached */
+			continue;
+		}
+		pinned += pins[npins].len;
+		if (pf->verbose)
+			printf("'%s': %lu bytes pinned\n", pins[npins].path,
+			    (unsigned long) pins[npins].len);
+		npins++;
+	}
+	printf("Pinned %.1f MB of %lu files (out of %lu).\n",
+	    (double) pinned / 1e6, (unsigned long) npins,
+	    (unsigned long) pf->nfiles);
+	fflush(stdout);
+
+	while (!released) {
+		ts.tv_sec = (time_t) interval;
+		ts.tv_nsec = 0;
+		if (nanosleep(&ts, NULL) == -1 && released)
+			break;
+
+		for (i = 0, lost = 0; i < npins; i++) {
+			missing = check_pin(&r, &pins[i]);
+			if (missing == 0)
+				continue;
+			warning(-1, "%llu pages of '%s' no longer in memory",
+			    missing, pins[i].path);
+			lost += missing;
+			if (mlock(pins[i].addr, pins[i].len) == -1)
+				warning(errno, "Unable to pin '%s' again",
+				    pins[i].path);
+		}
+		if (progress)
+			fprintf(stderr, "%.1f MB of %lu files pinned, %llu "
+			    "pages lost since the last check\n",
+			    (double) pinned / 1e6, (unsigned long) npins, lost);
+	}
+
+	for (i = 0; i < npins; i++) {
+		munlock(pins[i].addr, pins[i].len);
+		munmap(pins[i].addr, pins[i].len);
+		if (close(pins[i].fd) == -1)
+			warning(errno, "Problem closing '%s'", pins[i].path);
+	}
+	free(pins);
+	printf("Released %.1f MB of %lu files.\n", (double) pinned / 1e6,
+	    (unsigned long) npins);
+}
+
+
+int
+pathcmp(const void *a, const void *b)
+{
+	const struct pfile *fa = a, *fb = b;
+
+	return (strcmp(fa->path, fb->path));
+}
+
+
+enum method
+parse_method(const char *name)
+{
+	int m;
+
+	for (m = 0; m < METHOD_COUNT; m++) {
+		if (strcmp(name, method_names[m]) == 0)
+			break;
+	}
+	if (m == METHOD_COUNT)
+		error(1, -1, "Unknown prefetch method: '%s'", name);
+#ifndef __linux__
+	if (m == METHOD_READAHEAD)
+		error(1, -1, "readahead() is not supported on this system");
+#endif /* __linux__ */
+
+	return ((enum method) m);
+}
+
+
+/*
+ * MemFree from /proc/meminfo, in bytes (MemAvailable includes the pagecache
+ * which can be reclaimed, it hardly changes when files are prefetched).
+ */
+int
+mem_free(unsigned long long *avail)
+{
+	FILE	*fp;
+	char	 line[128];
+	int	 rc = -1;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (fp == NULL)
+		return (-1);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "MemFree: %llu kB", avail) == 1) {
+			*avail <<= 10;
+			rc = 0;
+			break;
+		}
+	}
+	fclose(fp);
+	if (rc == -1)
+		errno = ENOSYS;
+
+	return (rc);
+}
+
+
+/* Files found by the walk, to be prefetched afterwards */
+void
+add_file(void *arg, void *dir, const char *path, int fd,
+    const struct stat *st)
+{
+	struct prefetch	*pf = arg;
+	struct pfile	*files;
+	size_t		 n;
+
+	(void) dir;
+	(void) fd;
+
+	if (st->st_size == 0 || (unsigned long long) st->st_size
+	    <= pf->offset)
+		return;
+
+	pthread_mutex_lock(&pf->lock);
+	if (pf->nfiles == pf->alloc) {
+		n = pf->alloc ? pf->alloc * 2 : 64;
+		files = realloc(pf->files, n * sizeof(*files));
+		if (files == NULL)
+			error(2, errno, "Unable to allocate memory");
+		pf->files = files;
+		pf->alloc = n;
+	}
+	pf->files[pf->nfiles].path = strdup(path);
+	if (pf->files[pf->nfiles].path == NULL)
+		error(2, errno, "Unable to allocate memory");
+	pf->files[pf->nfiles].size = (unsigned long long) st->st_size;
+	pf->nfiles++;
+	pthread_mutex_unlock(&pf->lock);
+}
+
+
+/*
+ * Accounts for 'len' more bytes in the pagecache, returns -1 if the free
+ * memory would then drop below the threshold.  MemFree is only read every
+ * MEMINFO_EVERY bytes, in between it is estimated (as if none of the content
+ * prefetched was already in the pagecache).
+ */
+int
+reserve(struct prefetch *pf, unsigned long long len)
+{
+	int rc = 0;
+
+	if (pf->keep == 0)
+		return (0);
+
+	pthread_mutex_lock(&pf->lock);
+	if (!pf->stop && pf->since >= MEMINFO_EVERY) {
+		if (mem_free(&pf->avail) == 0)
+			pf->since = 0;
+	}
+	if (pf->stop || pf->avail < pf->keep + pf->since + len) {
+		pf->stop = 1;
+		rc = -1;
+	} else
+		pf->since += len;
+	pthread_mutex_unlock(&pf->lock);
+
+	return (rc);
+}
+
+
+/* Returns the bytes prefetched, -1 with errno set on failure */
+int
+prefetch_chunk(struct prefetch *pf, int fd, char *buf, unsigned long long off,
+    unsigned long long len)
+{
+	ssize_t	n;
+	int	rc;
+
+	switch (pf->method) {
+	case METHOD_HINT:
+		rc = posix_fadvise(fd, (off_t) off, (off_t) len,
+		    POSIX_FADV_WILLNEED);
+		if (rc != 0) {
+			errno = rc;
+			return (-1);
+		}
+		break;
+	case METHOD_READAHEAD:
+#ifdef __linux__
+		if (readahead(fd, (off_t) off, (size_t) len) == -1)
+			return (-1);
+#endif /* __linux__ */
+		break;
+	case METHOD_READ:
+		n = pread(fd, buf, (size_t) len, (off_t) off);
+		if (n == -1)
+			return (-1);
+		return ((int) n);
+	default:
+		break;
+	}
+
+	return ((int) len);
+}
+
+
+void
+prefetch_file(struct prefetch *pf, const struct pfile *f, char *buf)
+{
+	unsigned long long	 off, end, len, nbytes = 0;
+	int			 fd, n;
+
+	fd = open(f->path, O_RDONLY);
+	if (fd == -1) {
+		warning(errno, "Unable to open '%s'", f->path);
+		return;
+	}
+
+	off = pf->offset;
+	end = pf->length > 0 && pf->length < f->size - off ? off + pf->length
+	    : f->size;
+	for (; off < end; off += len) {
+		len = end - off < PREFETCH_CHUNK ? end - off : PREFETCH_CHUNK;
+		if (reserve(pf, len) == -1)
+			break;
+		n = prefetch_chunk(pf, fd, buf, off, len);
+		if (n == -1) {
+			warning(errno, "Unable to prefetch '%s'", f->path);
+			break;
+		}
+		__atomic_fetch_add(&pf->nbytes, (unsigned long long) n,
+		    __ATOMIC_RELAXED);
+		nbytes += (unsigned long long) n;
+		if ((unsigned long long) n < len)
+			break;		/* truncated since */
+	}
+	if (close(fd) == -1)
+		warning(errno, "Problem closing '%s'", f->path);
+
+	if (off >= end)
+		__atomic_fetch_add(&pf->ndone, 1, __ATOMIC_RELAXED);
+	if (pf->verbose)
+		printf("'%s': %llu bytes prefetched\n", f->path, nbytes);
+}
+
+
+/* Files from the list until there are none left (or no memory left) */
+void *
+prefetcher(void *arg)
+{
+	struct prefetch	*pf = arg;
+	uint64_t	 t_end;
+	char		*buf = NULL;
+	size_t		 i;
+
+	if (pf->method == METHOD_READ) {
+		buf = malloc(PREFETCH_CHUNK);
+		if (buf == NULL)
+			error(2, errno, "Unable to allocate memory");
+	}
+
+	for (;;) {
+		i = __atomic_fetch_add(&pf->next, 1, __ATOMIC_RELAXED);
+		if (i >= pf->nfiles || __atomic_load_n(&pf->stop,
+		    __ATOMIC_RELAXED))
+			break;
+		prefetch_file(pf, &pf->files[i], buf);
+	}
+	free(buf);
+	t_end = now_ns();
+	if (__atomic_sub_fetch(&pf->nrunning, 1, __ATOMIC_RELEASE) == 0)
+		pf->t_end = t_end;	/* read once all are joined */
+
+	return (NULL);
+}
+
+
+/* Files & bytes prefetched so far */
+void
+report(const struct prefetch *pf, double elapsed, FILE *fp,
+    const char *prefix)
+{
+	unsigned long long	 nbytes, ndone;
+
+	nbytes = __atomic_load_n(&pf->nbytes, __ATOMIC_RELAXED);
+	ndone = __atomic_load_n(&pf->ndone, __ATOMIC_RELAXED);
+	fprintf(fp, "%s%llu/%lu files, %.1f MB in %.2f s (%.1f MB/s)\n",
+	    prefix, ndone, (unsigned long) pf->nfiles, (double) nbytes / 1e6,
+	    elapsed, elapsed > 0.0 ? (double) nbytes / 1e6 / elapsed : 0.0);
+}
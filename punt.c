@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pool of threads doing blocking reads (pread()) on behalf of other
+ * threads, e.g. for the reads which could not be served from the pagecache
+ * without blocking.  Reads are served in submission order.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "punt.h"
+#include "util.h"
+
+static void *punter(void *);
+
+
+void *
+punter(void *arg)
+{
+	struct punt	*p = arg;
+	struct punt_io	*io;
+	struct punt_cq	*cq;
+
+	for (;;) {
+		pthread_mutex_lock(&p->lock);
+		while (p->head == NULL && !p->stop)
+			pthread_cond_wait(&p->cond, &p->lock);
+		io = p->head;
+		if (io == NULL) {
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+		p->head = io->next;
+		if (p->head == NULL)
+			p->tail = NULL;
+		pthread_mutex_unlock(&p->lock);
+
+		io->t_started = now_ns();
+		io->res = pread(io->fd, io->buf, io->len, io->offset);
+		if (io->res == -1)
+			io->res = -errno;
+		io->t_done = now_ns();
+
+		cq = io->cq;
+		io->next = NULL;
+		pthread_mutex_lock(&cq->lock);
+		if (cq->tail != NULL)
+			cq->tail->next = io;
+		else
+			cq->head = io;
+		cq->tail = io;
+		pthread_cond_signal(&cq->cond);
+		pthread_mutex_unlock(&cq->lock);
+	}
+
+	return (NULL);
+}
+
+
+/* Starts 'nthreads' threads, returns an error number on failure */
+int
+punt_init(struct punt *p, int nthreads)
+{
+	int rc, t;
+
+	memset(p, 0, sizeof(*p));
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	p->tids = calloc((size_t) nthreads, sizeof(*p->tids));
+	if (p->tids == NULL)
+		return (errno);
+
+	for (t = 0; t < nthreads; t++) {
+		rc = pthread_create(&p->tids[t], NULL, punter, p);
+		if (rc != 0) {
+			punt_fini(p);
+			return (rc);
+		}
+		p->nthreads++;
+	}
+
+	return (0);
+}
+
+
+/* Stops the threads once all the submitted reads are done */
+void
+punt_fini(struct punt *p)
+{
+	int t;
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+
+	for (t = 0; t < p->nthreads; t++)
+		pthread_join(p->tids[t], NULL);
+
+	free(p->tids);
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->lock);
+	memset(p, 0, sizeof(*p));
+}
+
+
+/* 'io->cq' must be set, the queueing time is set here */
+void
+punt_submit(struct punt *p, struct punt_io *io)
+{
+	io->next = NULL;
+	io->t_queued = now_ns();
+
+	pthread_mutex_lock(&p->lock);
+	if (p->tail != NULL)
+		p->tail->next = io;
+	else
+		p->head = io;
+	p->tail = io;
+	pthread_cond_signal(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+
+/* The condition variable uses the monotonic clock, for punt_reap_until() */
+int
+punt_cq_init(struct punt_cq *cq)
+{
+	pthread_condattr_t	attr;
+	int			rc;
+
+	memset(cq, 0, sizeof(*cq));
+	rc = pthread_mutex_init(&cq->lock, NULL);
+	if (rc == 0)
+		rc = pthread_condattr_init(&attr);
+	if (rc == 0) {
+		rc = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		if (rc == 0)
+			rc = pthread_cond_init(&cq->cond, &attr);
+		pthread_condattr_destroy(&attr);
+	}
+
+	return (rc);
+}
+
+
+void
+punt_cq_fini(struct punt_cq *cq)
+{
+	pthread_cond_destroy(&cq->cond);
+	pthread_mutex_destroy(&cq->lock);
+}
+
+
+/* Returns a completed read, waiting for one if 'wait', NULL if none */
+struct punt_io *
+punt_reap(struct punt_cq *cq, int wait)
+{
+	struct punt_io *io;
+
+	pthread_mutex_lock(&cq->lock);
+	while (wait && cq->head == NULL)
+		pthread_cond_wait(&cq->cond, &cq->lock);
+	io = cq->head;
+	if (io != NULL) {
+		cq->head = io->next;
+		if (cq->head == NULL)
+			cq->tail = NULL;
+	}
+	pthread_mutex_unlock(&cq->lock);
+
+	return (io);
+}
+
+
+/*
+ * Returns a completed read, waiting for one until 'deadline' (ns, monotonic
+ * clock), NULL if none by then
+ */
+struct punt_io *
+punt_reap_until(struct punt_cq *cq, uint64_t deadline)
+{
+	struct punt_io	*io;
+	struct timespec	 ts;
+
+	ts.tv_sec = (time_t) (deadline / 1000000000ULL);
+	ts.tv_nsec = (long) (deadline % 1000000000ULL);
+	pthread_mutex_lock(&cq->lock);
+	while (cq->head == NULL && pthread_cond_timedwait(&cq->cond,
+	    &cq->lock, &ts) != ETIMEDOUT)
+		;
+	io = cq->head;
+	if (io != NULL) {
+		cq->head = io->next;
+		if (cq->head == NULL)
+			cq->tail = NULL;
+	}
+	pthread_mutex_unlock(&cq->lock);
+
+	return (io);
+}
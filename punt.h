@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pool of threads doing blocking reads on behalf of other threads, which
+ * get the completed reads back from their own completion queue.
+ */
+
+#ifndef __PUNT_H__
+#define __PUNT_H__
+
+#include <sys/types.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+struct punt_cq;
+
+/* A read, owned by the submitting thread until it is reaped */
+struct punt_io {
+	int			 fd;
+	void			*buf;
+	size_t			 len;
+	off_t			 offset;
+	uint64_t		 udata;
+	ssize_t			 res;		/* negated errno on failure */
+	uint64_t		 t_queued;	/* ns, monotonic clock */
+	uint64_t		 t_started;
+	uint64_t		 t_done;
+	struct punt_cq		*cq;
+	struct punt_io		*next;
+};
+
+/* Completion queue, one per submitting thread */
+struct punt_cq {
+	pthread_mutex_t		 lock;
+	pthread_cond_t		 cond;
+	struct punt_io		*head;
+	struct punt_io		*tail;
+};
+
+struct punt {
+	pthread_mutex_t		 lock;
+	pthread_cond_t		 cond;
+	struct punt_io		*head;		/* submitted reads */
+	struct punt_io		*tail;
+	int			 stop;
+	int			 nthreads;
+	pthread_t		*tids;
+};
+
+extern int punt_init(struct punt *, int);
+extern void punt_fini(struct punt *);
+extern void punt_submit(struct punt *, struct punt_io *);
+extern int punt_cq_init(struct punt_cq *);
+extern void punt_cq_fini(struct punt_cq *);
+extern struct punt_io *punt_reap(struct punt_cq *, int);
+extern struct punt_io *punt_reap_until(struct punt_cq *, uint64_t);
+
+#endif /* __PUNT_H__ */
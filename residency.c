@@ -0,0 +1,503 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pagecache residency of files with mincore(): each window of the file is
+ * mapped, checked & unmapped in turn, with the same vector.
+ * The vectors are scanned 8 pages at a time by the portable kernel, 16 or
+ * 32 at a time with SSE2 or AVX2 on x86 (selected at run time).
+ * Where available (Linux 6.5 & later), cachestat() gives the number of
+ * cached, dirty, under writeback & evicted pages of a range without mapping
+ * it.
+ */
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "residency.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * Not always in the headers: 451 on the architectures sharing the generic
+ * numbering (others, e.g. MIPS or x32, offset it & rely on the headers)
+ */
+#if defined(__linux__) && !defined(__NR_cachestat)
+#if (defined(__x86_64__) && !defined(__ILP32__)) || defined(__i386__) \
+    || defined(__aarch64__) || (defined(__arm__) && defined(__ARM_EABI__)) \
+    || defined(__riscv) || defined(__powerpc__) || defined(__s390__) \
+    || defined(__loongarch__)
+#define __NR_cachestat	451
+#endif
+#endif /* __linux__ && !__NR_cachestat */
+
+#ifdef __NR_cachestat
+struct cachestat_range {
+	uint64_t	 off;
+	uint64_t	 len;
+};
+
+struct cachestat {
+	uint64_t	 nr_cache;
+	uint64_t	 nr_dirty;
+	uint64_t	 nr_writeback;
+	uint64_t	 nr_evicted;
+	uint64_t	 nr_recently_evicted;
+};
+#endif /* __NR_cachestat */
+
+struct counter {
+	const struct residency_kernel	*kernel;
+	unsigned long long		 pim;
+};
+
+/* Runs followed across the windows */
+struct runner {
+	const struct residency_kernel	*kernel;
+	residency_run_fn		 fn;
+	void				*arg;
+	unsigned long long		 start;
+	unsigned long long		 npages;	/* 0: no run pending */
+};
+
+static const uint64_t low_bits = 0x0101010101010101ULL;
+
+static void count_window(void *, const unsigned char *, unsigned long long,
+    size_t);
+static void run_window(void *, const unsigned char *, unsigned long long,
+    size_t);
+static int always(void);
+static size_t count_scalar(const unsigned char *, size_t);
+static size_t find_scalar(const unsigned char *, size_t, size_t, int);
+#ifdef HAVE_X86_SIMD
+static int has_sse2(void);
+static int has_avx2(void);
+static size_t count_sse2(const unsigned char *, size_t);
+static size_t find_sse2(const unsigned char *, size_t, size_t, int);
+static size_t count_avx2(const unsigned char *, size_t);
+static size_t find_avx2(const unsigned char *, size_t, size_t, int);
+#endif /* HAVE_X86_SIMD */
+
+/* Best first, ends with a NULL name */
+const struct residency_kernel residency_kernels[] = {
+#ifdef HAVE_X86_SIMD
+	{ "avx2",	has_avx2,	count_avx2,	find_avx2 },
+	{ "sse2",	has_sse2,	count_sse2,	find_sse2 },
+#endif /* HAVE_X86_SIMD */
+	{ "scalar",	always,		count_scalar,	find_scalar },
+	{ NULL,		NULL,		NULL,		NULL }
+};
+
+
+/* The named kernel (the best one if NULL), NULL if unknown or unsupported */
+const struct residency_kernel *
+residency_kernel(const char *name)
+{
+	const struct residency_kernel *k;
+
+	for (k = residency_kernels; k->name != NULL; k++) {
+		if (name != NULL && strcmp(name, k->name) != 0)
+			continue;
+		if (k->supported())
+			return (k);
+		if (name != NULL)
+			break;
+	}
+
+	return (NULL);
+}
+
+
+/* Returns 0, or -1 with errno set if the page size is unknown */
+int
+residency_init(struct residency *r)
+{
+	r->pagesize = sysconf(_SC_PAGESIZE);
+	r->kernel = residency_kernel(NULL);
+
+	return (r->pagesize == -1 ? -1 : 0);
+}
+
+
+/*
+ * Calls 'fn' for each window of the 'size' bytes of the file, in order.
+ * Returns 0, or -1 with errno set (the windows before were reported).
+ */
+int
+residency_scan(struct residency *r, int fd, off_t size, residency_fn fn,
+    void *arg)
+{
+	return (residency_scan_range(r, fd, 0, size, fn, arg));
+}
+
+
+/* As residency_scan(), for the pages of the file in [start:end) */
+int
+residency_scan_range(struct residency *r, int fd, off_t start, off_t end,
+    residency_fn fn, void *arg)
+{
+	off_t		 window = (off_t) RESIDENCY_PAGES * r->pagesize;
+	off_t		 offset;
+	size_t		 len;
+	void		*map;
+	int		 rc, serrno;
+
+	for (offset = start / r->pagesize * r->pagesize; offset < end;
+	    offset += window) {
+		len = (size_t) (end - offset < window ? end - offset
+		    : window);
+		map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, offset);
+		if (map == MAP_FAILED)
+			return (-1);
+#ifdef __linux__
+		rc = mincore(map, len, r->vec);
+#else
+		rc = mincore(map, len, (char *) r->vec);
+#endif
+		serrno = errno;
+		munmap(map, len);
+		if (rc == -1) {
+			errno = serrno;
+			return (-1);
+		}
+		fn(arg, r->vec, (unsigned long long) (offset / r->pagesize),
+		    (len + (size_t) r->pagesize - 1) / (size_t) r->pagesize);
+	}
+
+	return (0);
+}
+
+
+/*
+ * Calls 'fn' for each run of resident pages of the file, in order, once it
+ * is complete (runs go on across windows).  Files entirely (or not at all)
+ * in the pagecache are not mapped if '*cachestat', which is cleared when
+ * cachestat() turns out to be unavailable.  Returns 1 if 'st' has the counts
+ * of the file from cachestat(), 0 if not & -1 with errno set on failure.
+ */
+int
+residency_runs(struct residency *r, int fd, off_t size, int *cachestat,
+    struct residency_stat *st, residency_run_fn fn, void *arg)
+{
+	struct runner		 ru;
+	unsigned long long	 lip; /* lip: length in pages */
+	int			 extra = 0;
+
+	lip = (unsigned long long) ((size + r->pagesize - 1) / r->pagesize);
+	if (*cachestat) {
+		if (residency_stat(fd, 0, 0, st) == 0)
+			extra = 1;
+		else if (errno == ENOSYS || errno == EOPNOTSUPP)
+			*cachestat = 0;
+	}
+
+	/* Nothing or everything: no need to look closer */
+	if (extra && (st->cached == 0 || st->cached >= lip)) {
+		if (st->cached > 0)
+			fn(arg, 0, lip);
+		return (extra);
+	}
+
+	ru.kernel = r->kernel;
+	ru.fn = fn;
+	ru.arg = arg;
+	ru.start = ru.npages = 0;
+	if (residency_scan(r, fd, size, run_window, &ru) == -1)
+		return (-1);
+	if (ru.npages > 0)
+		fn(arg, ru.start, ru.npages);
+
+	return (extra);
+}
+
+
+/* Number of resident pages of the file, returns 0 or -1 with errno set */
+int
+residency_count(struct residency *r, int fd, off_t size,
+    unsigned long long *pim)
+{
+	return (residency_count_range(r, fd, 0, size, pim));
+}
+
+
+/* As residency_count(), for the pages of the file in [start:end) */
+int
+residency_count_range(struct residency *r, int fd, off_t start, off_t end,
+    unsigned long long *pim)
+{
+	struct counter	c;
+	int		rc;
+
+	c.kernel = r->kernel;
+	c.pim = 0;
+	rc = residency_scan_range(r, fd, start, end, count_window, &c);
+	*pim = c.pim;
+
+	return (rc);
+}
+
+
+/*
+ * Page counts of 'len' bytes (up to the end of the file if 0) from 'offset',
+ * returns 0 or -1 with errno set (ENOSYS if cachestat() is not available).
+ */
+int
+residency_stat(int fd, off_t offset, off_t len, struct residency_stat *st)
+{
+#ifdef __NR_cachestat
+	struct cachestat_range	 range;
+	struct cachestat	 cs;
+
+	range.off = (uint64_t) offset;
+	range.len = (uint64_t) len;
+	if (syscall(__NR_cachestat, fd, &range, &cs, 0U) == -1)
+		return (-1);
+
+	st->cached = cs.nr_cache;
+	st->dirty = cs.nr_dirty;
+	st->writeback = cs.nr_writeback;
+	st->evicted = cs.nr_evicted;
+	st->recently_evicted = cs.nr_recently_evicted;
+
+	return (0);
+#else
+	(void) fd;
+	(void) offset;
+	(void) len;
+	(void) st;
+	errno = ENOSYS;
+
+	return (-1);
+#endif /* __NR_cachestat */
+}
+
+
+void
+count_window(void *arg, const unsigned char *vec, unsigned long long first,
+    size_t n)
+{
+	struct counter *c = arg;
+
+	(void) first;
+	c->pim += c->kernel->count(vec, n);
+}
+
+
+/* From one run boundary to the next */
+void
+run_window(void *arg, const unsigned char *vec, unsigned long long first,
+    size_t n)
+{
+	struct runner	*ru = arg;
+	size_t		 k = 0, e;
+
+	while (k < n) {
+		k = ru->kernel->find(vec, k, n, 1);
+		if (k == n)
+			break;
+		e = ru->kernel->find(vec, k, n, 0);
+		if (ru->npages > 0 && ru->start + ru->npages == first + k)
+			ru->npages += e - k;
+		else {
+			if (ru->npages > 0)
+				ru->fn(ru->arg, ru->start, ru->npages);
+			ru->start = first + k;
+			ru->npages = e - k;
+		}
+		k = e;
+	}
+}
+
+
+int
+always(void)
+{
+	return (1);
+}
+
+
+/* Bit 0 of 8 bytes at a time, summed with a multiplication */
+size_t
+count_scalar(const unsigned char *vec, size_t n)
+{
+	uint64_t	 x;
+	size_t		 k, c = 0;
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		memcpy(&x, vec + k, sizeof(x));
+		c += (size_t) (((x & low_bits) * low_bits) >> 56);
+	}
+	for (; k < n; k++)
+		c += vec[k] & 1;
+
+	return (c);
+}
+
+
+/* Skips 8 bytes at a time while none can match */
+size_t
+find_scalar(const unsigned char *vec, size_t from, size_t n, int resident)
+{
+	uint64_t	 x, none = resident ? 0 : low_bits;
+	size_t		 k = from, end = from + 8 < n ? from + 8 : n;
+
+	for (; k < end; k++)
+		if ((vec[k] & 1) == (resident != 0))
+			return (k);
+
+	for (; k + 8 <= n; k += 8) {
+		memcpy(&x, vec + k, sizeof(x));
+		if ((x & low_bits) != none)
+			break;
+	}
+	for (; k < n; k++)
+		if ((vec[k] & 1) == (resident != 0))
+			return (k);
+
+	return (n);
+}
+
+#ifdef HAVE_X86_SIMD
+
+int
+has_sse2(void)
+{
+	return (__builtin_cpu_supports("sse2"));
+}
+
+
+int
+has_avx2(void)
+{
+	return (__builtin_cpu_supports("avx2"));
+}
+
+
+/*
+ * The bit 0 of up to 255 vectors are added bytewise before being summed
+ * (psadbw) in the 64 bits lanes of the accumulator.
+ */
+__attribute__((target("sse2"))) size_t
+count_sse2(const unsigned char *vec, size_t n)
+{
+	const __m128i	 one = _mm_set1_epi8(1), zero = _mm_setzero_si128();
+	__m128i		 acc = zero, bytes;
+	uint64_t	 lanes[2];
+	size_t		 k = 0, end;
+
+	while (k + 16 <= n) {
+		end = k + 255 * 16 < n ? k + 255 * 16 : n;
+		bytes = zero;
+		for (; k + 16 <= end; k += 16)
+			bytes = _mm_add_epi8(bytes, _mm_and_si128(one,
+			    _mm_loadu_si128((const __m128i *) (vec + k))));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(bytes, zero));
+	}
+	_mm_storeu_si128((__m128i *) lanes, acc);
+
+	return ((size_t) (lanes[0] + lanes[1]) + count_scalar(vec + k,
+	    n - k));
+}
+
+
+__attribute__((target("sse2"))) size_t
+find_sse2(const unsigned char *vec, size_t from, size_t n, int resident)
+{
+	__m128i		 one, want, v;
+	unsigned	 m;
+	size_t		 k = from, end = from + 8 < n ? from + 8 : n;
+
+	/* Short runs are common, look at the first pages one by one */
+	for (; k < end; k++)
+		if ((vec[k] & 1) == (resident != 0))
+			return (k);
+
+	one = _mm_set1_epi8(1);
+	want = resident ? one : _mm_setzero_si128();
+
+	for (; k + 16 <= n; k += 16) {
+		v = _mm_and_si128(one, _mm_loadu_si128((const __m128i *)
+		    (vec + k)));
+		m = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, want));
+		if (m != 0)
+			return (k + (size_t) __builtin_ctz(m));
+	}
+
+	return (find_scalar(vec, k, n, resident));
+}
+
+
+__attribute__((target("avx2"))) size_t
+count_avx2(const unsigned char *vec, size_t n)
+{
+	const __m256i	 one = _mm256_set1_epi8(1);
+	const __m256i	 zero = _mm256_setzero_si256();
+	__m256i		 acc = zero, bytes;
+	uint64_t	 lanes[4];
+	size_t		 k = 0, end;
+
+	while (k + 32 <= n) {
+		end = k + 255 * 32 < n ? k + 255 * 32 : n;
+		bytes = zero;
+		for (; k + 32 <= end; k += 32)
+			bytes = _mm256_add_epi8(bytes, _mm256_and_si256(one,
+			    _mm256_loadu_si256((const __m256i *) (vec + k))));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes, zero));
+	}
+	_mm256_storeu_si256((__m256i *) lanes, acc);
+
+	return ((size_t) (lanes[0] + lanes[1] + lanes[2] + lanes[3])
+	    + count_scalar(vec + k, n - k));
+}
+
+
+__attribute__((target("avx2"))) size_t
+find_avx2(const unsigned char *vec, size_t from, size_t n, int resident)
+{
+	__m256i		 one, want, v;
+	unsigned	 m;
+	size_t		 k = from, end = from + 8 < n ? from + 8 : n;
+
+	/* Short runs are common, look at the first pages one by one */
+	for (; k < end; k++)
+		if ((vec[k] & 1) == (resident != 0))
+			return (k);
+
+	one = _mm256_set1_epi8(1);
+	want = resident ? one : _mm256_setzero_si256();
+
+	for (; k + 32 <= n; k += 32) {
+		v = _mm256_and_si256(one, _mm256_loadu_si256((const __m256i *)
+		    (vec + k)));
+		m = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v,
+		    want));
+		if (m != 0)
+			return (k + (size_t) __builtin_ctz(m));
+	}
+
+	return (find_sse2(vec, k, n, resident));
+}
+
+#endif /* HAVE_X86_SIMD */
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pagecache residency of files with mincore(), a window at a time so that
+ * the memory used does not depend on the size of the files.
+ */
+
+#ifndef __RESIDENCY_H__
+#define __RESIDENCY_H__
+
+#include <sys/types.h>
+
+#include <stddef.h>
+
+/* Pages per window (64 MB with 4 KB pages) */
+#define RESIDENCY_PAGES	16384
+
+/* Vector scanning functions, the best supported one is used by default */
+struct residency_kernel {
+	const char		*name;
+	int			 (*supported)(void);
+	/* Resident pages in vec[0:n) */
+	size_t			 (*count)(const unsigned char *, size_t);
+	/* First page in vec[from:n) resident (or not), n if none */
+	size_t			 (*find)(const unsigned char *, size_t, size_t,
+				    int);
+};
+
+/* Page counts of a range, from cachestat() */
+struct residency_stat {
+	unsigned long long		 cached;
+	unsigned long long		 dirty;
+	unsigned long long		 writeback;
+	unsigned long long		 evicted;
+	unsigned long long		 recently_evicted;
+};
+
+struct residency {
+	long int			 pagesize;
+	const struct residency_kernel	*kernel;
+	unsigned char			 vec[RESIDENCY_PAGES];
+};
+
+/* Window of 'n' pages from page 'first', bit 0 set for resident pages */
+typedef void (*residency_fn)(void *, const unsigned char *,
+    unsigned long long, size_t);
+
+/* Run of resident pages, from its first page & its length in pages */
+typedef void (*residency_run_fn)(void *, unsigned long long,
+    unsigned long long);
+
+extern const struct residency_kernel residency_kernels[];
+
+extern const struct residency_kernel *residency_kernel(const char *);
+extern int residency_init(struct residency *);
+extern int residency_scan(struct residency *, int, off_t, residency_fn,
+    void *);
+extern int residency_scan_range(struct residency *, int, off_t, off_t,
+    residency_fn, void *);
+extern int residency_runs(struct residency *, int, off_t, int *,
+    struct residency_stat *, residency_run_fn, void *);
+extern int residency_count(struct residency *, int, off_t,
+    unsigned long long *);
+extern int residency_count_range(struct residency *, int, off_t, off_t,
+    unsigned long long *);
+extern int residency_stat(int, off_t, off_t, struct residency_stat *);
+
+#endif /* __RESIDENCY_H__ */
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * restore-pagecache: prefetches in the pagecache the parts of files saved in
+ * a snapshot by save-pagecache (or "slices-in-pagecache -o"), e.g. to warm
+ * up the pagecache after a reboot.
+ * The files are spread over a pool of threads, each file is prefetched in
+ * file offset order with hints to the pagecache, at an optionally limited
+ * rate.  The files changed since the snapshot was saved (different size,
+ * mtime or inode) are skipped.
+ */
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "errwarn.h"
+#include "snapshot.h"
+#include "util.h"
+
+/* Bytes prefetched at once, the unit of the rate limit */
+#define RESTORE_CHUNK	(1 << 20)
+
+const char progname[] = "restore-pagecache";
+
+struct restore {
+	const struct snapshot	*snap;
+	double			 rate;		/* bytes/s, 0 if unlimited */
+	int			 dryrun;
+	int			 verbose;
+	size_t			 next;		/* file, atomic */
+	pthread_mutex_t		 lock;		/* for the following */
+	uint64_t		 t_next;	/* ns, next chunk allowed */
+	unsigned long long	 nrestored;
+	unsigned long long	 nchanged;
+	unsigned long long	 nmissing;
+	unsigned long long	 nbytes;
+};
+
+void usage(FILE *);
+void throttle(struct restore *, unsigned long long);
+int changed(const struct snap_file *, const struct stat *);
+void restore_file(struct restore *, const struct snap_file *);
+void *restorer(void *);
+
+void usage(FILE *fp)
+{
+	fprintf(fp,
+"\nPrefetches in the pagecache the parts of files saved in a snapshot.\n"
+"\nUsage:\n"
+"%s [-j threads] [-n] [-r MB/s] [-v] snapshot\n"
+"\nWhere:\n"
+" -j threads: number of threads prefetching files, default is the number of\n"
+"    online processors.\n"
+" -n only reports what would be prefetched.\n"
+" -r MB/s: limits the rate at which the files are prefetched (in MB/s).\n"
+" -v reports every file prefetched or skipped.\n"
+"\nThe snapshot is saved by save-pagecache (\"-\" for the standard input),\n"
+"the files changed since then (different size, mtime or inode) are skipped.\n",
+	    progname);
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct snapshot	 snap;
+	struct restore	 rs;
+	pthread_t	*tids;
+	uint64_t	 t0;
+	double		 elapsed;
+	long int	 nthreads, pagesize;
+	int		 ch, t, rc;
+
+	memset(&rs, 0, sizeof(rs));
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1)
+		nthreads = 1;
+
+	while ((ch = getopt(argc, argv, ":hj:nr:v")) != -1) {
+		switch (ch) {
+		case 'h':
+			usage(stdout);
+			exit(0);
+		case 'j':
+			nthreads = atol(optarg);
+			if (nthreads < 1 || nthreads > 1024)
+				error(1, -1, "Invalid number of threads: '%s'",
+				    optarg);
+			break;
+		case 'n':
+			rs.dryrun = 1;
+			break;
+		case 'r':
+			rs.rate = strtod(optarg, NULL) * 1e6;
+			if (rs.rate <= 0.0)
+				error(1, -1, "Invalid rate: '%s'", optarg);
+			break;
+		case 'v':
+			rs.verbose = 1;
+			break;
+		case ':':
+			usage(stderr);
+			error(1, -1, "Option -%c requires an argument", optopt);
+			break;
+		default:
+			usage(stderr);
+			error(1, -1, "Unknown option: -%c", optopt);
+			break;
+		}
+	}
+	if (argc - optind != 1) {
+		usage(stderr);
+		exit(1);
+	}
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	if (pagesize == -1)
+		error(1, errno, "Unable to get pagesize");
+	if (snapshot_read(&snap, argv[optind]) == -1)
+		error(1, errno, "Unable to read snapshot '%s'", argv[optind]);
+	if (snap.pagesize != (uint32_t) pagesize)
+		error(1, -1, "Snapshot of pages of %lu bytes, not %ld",
+		    (unsigned long) snap.pagesize, pagesize);
+	rs.snap = &snap;
+	if ((size_t) nthreads > snap.nfiles)
+		nthreads = snap.nfiles > 0 ? (long int) snap.nfiles : 1;
+
+	tids = calloc((size_t) nthreads, sizeof(*tids));
+	if (tids == NULL)
+		error(2, errno, "Unable to allocate memory");
+	pthread_mutex_init(&rs.lock, NULL);
+
+	t0 = now_ns();
+	for (t = 0; t < nthreads; t++) {
+		rc = pthread_create(&tids[t], NULL, restorer, &rs);
+		if (rc != 0)
+			error(2, rc, "Unable to create thread %d", t);
+	}
+	for (t = 0; t < nthreads; t++)
+		pthread_join(tids[t], NULL);
+	elapsed = (double) (now_ns() - t0) / 1e9;
+
+	printf("%s %llu files (%.1f MB) in %.2f s (%.1f MB/s), skipped %llu "
+	    "changed & %llu missing files.\n", rs.dryrun ? "Would prefetch"
+	    : "Prefetched", rs.nrestored, (double) rs.nbytes / 1e6, elapsed,
+	    elapsed > 0.0 ? (double) rs.nbytes / 1e6 / elapsed : 0.0,
+	    rs.nchanged, rs.nmissing);
+
+	pthread_mutex_destroy(&rs.lock);
+	free(tids);
+	snapshot_free(&snap);
+
+	return (0);
+}
+
+
+/* Waits for the turn of 'nbytes' more, shared by all the threads */
+void
+throttle(struct restore *rs, unsigned long long nbytes)
+{
+	struct timespec	 ts;
+	uint64_t	 now, t;
+
+	if (rs->rate <= 0.0)
+		return;
+
+	pthread_mutex_lock(&rs->lock);
+	now = now_ns();
+	if (rs->t_next < now)
+		rs->t_next = now;
+	t = rs->t_next;
+	rs->t_next += (uint64_t) ((double) nbytes * 1e9 / rs->rate);
+	pthread_mutex_unlock(&rs->lock);
+
+	if (t > now) {
+		ts.tv_sec = (time_t) ((t - now) / 1000000000ULL);
+		ts.tv_nsec = (long) ((t - now) % 1000000000ULL);
+		while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+			;
+	}
+}
+
+
+/* Whether the file is not the one of the snapshot anymore */
+int
+changed(const struct snap_file *f, const struct stat *st)
+{
+	struct snap_file now;
+
+	memset(&now, 0, sizeof(now));
+	now.size = (uint64_t) st->st_size;
+	now.mtime = (int64_t) st->st_mtime;
+#ifdef __linux__
+	now.mtime_nsec = (uint32_t) st->st_mtim.tv_nsec;
+#endif /* __linux__ */
+	now.ino = (uint64_t) st->st_ino;
+
+	return (!snapshot_same_file(f, &now));
+}
+
+
+void
+restore_file(struct restore *rs, const struct snap_file *f)
+{
+	struct stat		 st;
+	unsigned long long	 pgsz = rs->snap->pagesize;
+	unsigned long long	 off, end, len, nbytes = 0;
+	size_t			 i;
+	int			 fd, rc = 0;
+
+	fd = open(f->path, O_RDONLY);
+	if (fd == -1) {
+		if (errno != ENOENT)
+			warning(errno, "Unable to open '%s'", f->path);
+		else if (rs->verbose)
+			printf("'%s': missing, skipped\n", f->path);
+		__atomic_fetch_add(&rs->nmissing, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	if (fstat(fd, &st) == -1) {
+		warning(errno, "Unable to stat '%s'", f->path);
+		close(fd);
+		return;
+	}
+	if (changed(f, &st)) {
+		if (rs->verbose)
+			printf("'%s': changed, skipped\n", f->path);
+		__atomic_fetch_add(&rs->nchanged, 1, __ATOMIC_RELAXED);
+		close(fd);
+		return;
+	}
+
+	/* In file offset order, a chunk at a time */
+	for (i = 0; rc == 0 && i < f->nruns; i++) {
+		off = f->runs[i].start * pgsz;
+		end = (f->runs[i].start + f->runs[i].npages) * pgsz;
+		if (end > f->size)
+			end = f->size;
+		for (; rc == 0 && off < end; off += len) {
+			len = end - off < RESTORE_CHUNK ? end - off
+			    : RESTORE_CHUNK;
+			if (rs->dryrun) {
+				nbytes += len;
+				continue;
+			}
+			throttle(rs, len);
+			rc = posix_fadvise(fd, (off_t) off, (off_t) len,
+			    POSIX_FADV_WILLNEED);
+			if (rc != 0)
+				warning(rc, "Unable to give cache hint for "
+				    "'%s'", f->path);
+			else
+				nbytes += len;
+		}
+	}
+	if (close(fd) == -1)
+		warning(errno, "Problem closing '%s'", f->path);
+
+	if (rs->verbose)
+		printf("'%s': %llu bytes in %lu slices\n", f->path, nbytes,
+		    (unsigned long) f->nruns);
+	__atomic_fetch_add(&rs->nrestored, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rs->nbytes, nbytes, __ATOMIC_RELAXED);
+}
+
+
+/* Files from the snapshot until there are none left */
+void *
+restorer(void *arg)
+{
+	struct restore	*rs = arg;
+	size_t		 i;
+
+	for (;;) {
+		i = __atomic_fetch_add(&rs->next, 1, __ATOMIC_RELAXED);
+		if (i >= rs->snap->nfiles)
+			break;
+		restore_file(rs, &rs->snap->files[i]);
+	}
+
+	return (NULL);
+}
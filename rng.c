@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * xoshiro256** & splitmix64, see Blackman & Vigna, "Scrambled linear
+ * pseudorandom number generators", ACM TOMS 2021.
+ */
+
+#include <stdint.h>
+
+#include "rng.h"
+
+static uint64_t rotl(uint64_t, int);
+static uint64_t splitmix64(uint64_t *);
+static uint64_t mulhi64(uint64_t, uint64_t);
+
+
+/* The state is filled with splitmix64 so that close seeds diverge at once */
+void
+rng_seed(struct rng *r, uint64_t seed)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r->s[i] = splitmix64(&seed);
+}
+
+
+uint64_t
+rng_next(struct rng *r)
+{
+	uint64_t	*s = r->s;
+	uint64_t	 res = rotl(s[1] * 5, 7) * 9;
+	uint64_t	 t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return (res);
+}
+
+
+/*
+ * [0:n), with a multiplication instead of a division (Lemire), the bias is
+ * negligible for the ranges used here.
+ */
+uint64_t
+rng_below(struct rng *r, uint64_t n)
+{
+	return (mulhi64(rng_next(r), n));
+}
+
+
+/* [0:1), with the 53 upper bits */
+double
+rng_unit(struct rng *r)
+{
+	return ((double) (rng_next(r) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+
+uint64_t
+rotl(uint64_t x, int k)
+{
+	return ((x << k) | (x >> (64 - k)));
+}
+
+
+uint64_t
+splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return (z ^ (z >> 31));
+}
+
+
+/* Upper half of the 128 bits product, without a 128 bits type */
+uint64_t
+mulhi64(uint64_t a, uint64_t b)
+{
+	uint64_t	 alo = a & 0xffffffffULL, ahi = a >> 32;
+	uint64_t	 blo = b & 0xffffffffULL, bhi = b >> 32;
+	uint64_t	 lolo = alo * blo, hilo = ahi * blo, lohi = alo * bhi;
+	uint64_t	 mid = (lolo >> 32) + (hilo & 0xffffffffULL) + lohi;
+
+	return (ahi * bhi + (hilo >> 32) + (mid >> 32));
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Small & fast pseudo random number generator (xoshiro256**, seeded with
+ * splitmix64), with a reproducible sequence for a given seed.
+ */
+
+#ifndef __RNG_H__
+#define __RNG_H__
+
+#include <stdint.h>
+
+struct rng {
+	uint64_t		 s[4];
+};
+
+extern void rng_seed(struct rng *, uint64_t);
+extern uint64_t rng_next(struct rng *);
+extern uint64_t rng_below(struct rng *, uint64_t);
+extern double rng_unit(struct rng *);
+
+#endif /* __RNG_H__ */
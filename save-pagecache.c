@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * save-pagecache: saves which parts of files (or of the files in directory
+ * trees) are in the pagecache, in a snapshot for restore-pagecache.
+ * Directories are scanned recursively by a pool of threads, only the files
+ * with some resident pages are saved.
+ * All these files must be readable by the user.
+ */
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "errwarn.h"
+#include "residency.h"
+#include "snapshot.h"
+#include "walk.h"
+
+const char progname[] = "save-pagecache";
+
+struct save {
+	int			 cachestat;	/* still tried */
+	int			 verbose;
+	pthread_mutex_t		 lock;		/* for the following */
+	struct snapshot		 snap;
+	unsigned long long	 nfiles;	/* scanned */
+	unsigned long long	 npages;	/* saved */
+};
+
+void usage(FILE *);
+void save_file(void *, void *, const char *, int, const struct stat *);
+
+void usage(FILE *fp)
+{
+	fprintf(fp,
+"\nSaves which parts of files are in the pagecache.\n"
+"\nUsage:\n"
+"%s [-j threads] [-M] [-v] -o snapshot file|directory ...\n"
+"\nWhere:\n"
+" -j threads: number of threads scanning the directories, default is the\n"
+"    number of online processors.\n"
+" -M always uses mincore(), even if cachestat() is available.\n"
+" -o snapshot: where the slices of the files in the pagecache are saved\n"
+"    (\"-\" for the standard output).\n"
+" -v reports every file saved (on the standard error).\n"
+"\nDirectories are scanned recursively (symbolic links in the directories are\n"
+"not followed), the paths saved are absolute.  The snapshot can be restored with\n"
+"restore-pagecache or compared with \"slices-in-pagecache -d\".\n",
+	    progname);
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct walk_ops	 ops = { NULL, save_file, NULL };
+	struct save	 sv;
+	const char	*output = NULL;
+	char		**roots;
+	long int	 nthreads, pagesize;
+	int		 ch, rc, i;
+
+	memset(&sv, 0, sizeof(sv));
+	sv.cachestat = 1;
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1)
+		nthreads = 1;
+
+	while ((ch = getopt(argc, argv, ":hj:Mo:v")) != -1) {
+		switch (ch) {
+		case 'h':
+			usage(stdout);
+			exit(0);
+		case 'j':
+			nthreads = atol(optarg);
+			if (nthreads < 1 || nthreads > 1024)
+				error(1, -1, "Invalid number of threads: '%s'",
+				    optarg);
+			break;
+		case 'M':
+			sv.cachestat = 0;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'v':
+			sv.verbose = 1;
+			break;
+		case ':':
+			usage(stderr);
+			error(1, -1, "Option -%c requires an argument", optopt);
+			break;
+		default:
+			usage(stderr);
+			error(1, -1, "Unknown option: -%c", optopt);
+			break;
+		}
+	}
+	if (optind == argc || output == NULL) {
+		usage(stderr);
+		exit(1);
+	}
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	if (pagesize == -1)
+		error(1, errno, "Unable to get pagesize");
+	snapshot_init(&sv.snap, (uint32_t) pagesize);
+	pthread_mutex_init(&sv.lock, NULL);
+
+	/* Absolute paths, the snapshot may be restored from anywhere */
+	roots = calloc((size_t) (argc - optind), sizeof(*roots));
+	if (roots == NULL)
+		error(2, errno, "Unable to allocate memory");
+	for (i = optind; i < argc; i++) {
+		roots[i - optind] = realpath(argv[i], NULL);
+		if (roots[i - optind] == NULL)
+			error(1, errno, "Unable to resolve '%s'", argv[i]);
+	}
+
+	rc = walk((const char *const *) roots, argc - optind, (int) nthreads,
+	    &ops, &sv);
+	if (rc != 0)
+		error(2, rc, "Unable to scan the files");
+
+	/* In path order, whatever the order of the scan */
+	snapshot_sort(&sv.snap);
+	if (snapshot_write(&sv.snap, output) == -1)
+		error(2, errno, "Unable to save snapshot '%s'", output);
+	fprintf(strcmp(output, "-") == 0 ? stderr : stdout,
+	    "Saved %llu pages of %lu files (out of %llu files scanned).\n",
+	    sv.npages, (unsigned long) sv.snap.nfiles, sv.nfiles);
+
+	for (i = 0; i < argc - optind; i++)
+		free(roots[i]);
+	free(roots);
+	snapshot_free(&sv.snap);
+	pthread_mutex_destroy(&sv.lock);
+
+	return (0);
+}
+
+
+void
+save_file(void *arg, void *dir, const char *path, int fd,
+    const struct stat *st)
+{
+	struct save		*sv = arg;
+	struct residency	 r;
+	struct snap_file	 f;
+	unsigned long long	 npages;
+	int			 cachestat, rc;
+
+	(void) dir;
+
+	if (st->st_size == 0)
+		return;
+	if (snapshot_file_init(&f, path, st) == -1)
+		error(2, errno, "Unable to allocate memory");
+
+	/* cachestat() is no longer tried once known to be unavailable */
+	cachestat = __atomic_load_n(&sv->cachestat, __ATOMIC_RELAXED);
+	if (residency_init(&r) == -1
+	    || snapshot_scan(&r, fd, &f, &cachestat) == -1) {
+		warning(errno, "Unable to get core info for '%s'", path);
+		snapshot_free_file(&f);
+		return;
+	}
+	if (!cachestat)
+		__atomic_store_n(&sv->cachestat, 0, __ATOMIC_RELAXED);
+
+	npages = (unsigned long long) snapshot_resident(&f);
+	if (npages > 0 && sv->verbose)
+		fprintf(stderr, "'%s': %llu pages in %lu slices\n", path,
+		    npages, (unsigned long) f.nruns);
+
+	pthread_mutex_lock(&sv->lock);
+	sv->nfiles++;
+	sv->npages += npages;
+	rc = npages > 0 ? snapshot_add(&sv->snap, &f) : 0;
+	pthread_mutex_unlock(&sv->lock);
+	if (rc == -1)
+		error(2, errno, "Unable to allocate memory");
+	snapshot_free_file(&f);
+}
@@ -15,126 +15,773 @@
  *
  * slices-in-pagecache: try to infer which parts of files are actually in
  * pagecache.
+ * Where cachestat() is available, files entirely (or not at all) in the
+ * pagecache are not mapped & the dirty & writeback pages of each slice are
+ * counted.
+ * The slices can also be saved in a snapshot, displayed as JSON, or
+ * compared between two snapshots (or a snapshot & the current content of
+ * the pagecache).
+ * For large files, a heatmap (the resident part of each of a number of
+ * buckets) & a histogram of the lengths of the slices are more readable.
  * All these files must be readable by the user.
  */
 
-#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <langinfo.h>
+#include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "errwarn.h"
+#include "residency.h"
+#include "snapshot.h"
+#include "util.h"
 
 const char progname[] = "slices-in-pagecache";
 
-void print_slice(int, long int, long int, long int);
+/* Width of the bars of the heatmap & histogram */
+#define BAR_WIDTH	40
 
+/* Resident pages per bucket & slices by length (log2 of their pages) */
+struct heatmap {
+	unsigned long long	 bucket;	/* pages */
+	unsigned long long	 nbuckets;
+	unsigned long long	*resident;
+	unsigned long long	 nslices[64];
+	unsigned long long	 npages[64];
+	unsigned long long	 total;		/* resident pages */
+};
+
+/*
+ * Slices of resident pages, displayed as they are found, recorded in a
+ * snapshot only if needed.
+ */
+struct slicer {
+	struct snap_file	*file;		/* or NULL */
+	struct heatmap		*heat;		/* or NULL */
+	int			 show;		/* display the slices */
+	int			 json;
+	int			 fd;
+	const int		*cachestat;	/* counts per slice if set */
+	long int		 pagesize;
+	int			 sindex;
+	unsigned long long	 pim;		/* pages in memory */
+	int			 error;		/* errno, runs lost */
+};
+
+/* Slices loaded & evicted between two snapshots of a file */
+struct change {
+	const char		*status;
+	struct snap_file	 loaded;
+	struct snap_file	 evicted;
+};
+
+void usage(FILE *);
+void print_string(const char *);
+void print_slice(int, long int, int, const struct snap_run *, int);
+void print_summary(unsigned long long, unsigned long long,
+    const struct residency_stat *);
+void print_bar(double, int);
+void print_heatmap(const struct heatmap *, unsigned long long, long int,
+    int);
+void print_json_head(const struct snap_file *, long int, int, int);
+void print_json_tail(const struct slicer *, unsigned long long,
+    const struct residency_stat *);
+unsigned long long parse_buckets(const char *, int *);
+void heat_init(struct heatmap *, unsigned long long, unsigned long long,
+    int, long int);
+void heat_add(struct heatmap *, unsigned long long, unsigned long long);
+void slice_add(void *, unsigned long long, unsigned long long);
+int slice_file(struct residency *, int, off_t, struct slicer *, int *,
+    struct residency_stat *);
+void take_current(struct residency *, const struct snapshot *,
+    struct snapshot *, int *);
+void compare(const struct snap_file *, const struct snap_file *,
+    struct change *);
+void print_change(const struct change *, const char *, long int, int);
+void print_runs(const char *, const struct snap_file *, long int, int);
+void diff(const struct snapshot *, const struct snapshot *, int);
+
+void usage(FILE *fp)
+{
+	fprintf(fp,
+"\nDisplays which parts of files are in the pagecache.\n"
+"\nUsage:\n"
+"%s [-J] [-M] [-o snapshot] file ...\n"
+"%s [-J] [-M] -H buckets|size file ...\n"
+"%s [-J] [-M] -d snapshot [snapshot | -o snapshot]\n"
+"\nWhere:\n"
+" -d snapshot: displays the slices loaded in (or evicted from) the pagecache\n"
+"    since the snapshot was saved, compared to another snapshot or to the\n"
+"    current content of the pagecache (for the files of the snapshot).\n"
+" -H buckets|size: displays a heatmap of each file (the part of each bucket\n"
+"    in the pagecache) & a histogram of the lengths of the slices, instead\n"
+"    of the slices.  The files are divided in a number of buckets, or in\n"
+"    buckets of a size with a K, M, G or T suffix (e.g. \"1G\").\n"
+" -J displays the slices (or the differences between snapshots) as JSON.\n"
+" -M always uses mincore() only, even if cachestat() is available (the\n"
+"    dirty, writeback & evicted pages are then not reported).\n"
+" -o snapshot: saves the slices in a snapshot (\"-\" for the standard\n"
+"    output) instead of displaying them (unless -J is used).\n",
+	    progname, progname, progname);
+}
+
+
+/* As a JSON string */
 void
-print_slice(int sdx, long int pgsz, long int slstart, long int slend)
+print_string(const char *s)
 {
-	/* sim: pages in memory in "this slice", "+ 1" since slstart is
-	 * 0-based
-	 */
-	unsigned long sim = (slend + 1 - slstart) / pgsz;
-	printf("\tSlice[%d]: %lu:%lu (%lu pages)\n", sdx, slstart, slend, sim);
+	const char *c;
+
+	putchar('"');
+	for (c = s; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\')
+			putchar('\\');
+		if ((unsigned char) *c < 0x20)
+			printf("\\u%04x", (unsigned) *c);
+		else
+			putchar(*c);
+	}
+	putchar('"');
 }
 
-int main(int argc, char *argv[])
+
+/*
+ * A slice, as text or JSON, with its dirty & writeback pages if 'fd' is
+ * not -1.
+ */
+void
+print_slice(int fd, long int pagesize, int sindex, const struct snap_run *run,
+    int json)
+{
+	struct residency_stat	 rs;
+	unsigned long long	 pgsz = (unsigned long long) pagesize;
+	unsigned long long	 start = run->start * pgsz;
+	unsigned long long	 end = (run->start + run->npages) * pgsz - 1;
+	int			 extra;
+
+	extra = fd != -1 && residency_stat(fd, (off_t) start,
+	    (off_t) (end + 1 - start), &rs) == 0;
+	if (json) {
+		printf("%s\n      { \"start\": %llu, \"end\": %llu, "
+		    "\"pages\": %llu", sindex > 0 ? "," : "", start, end,
+		    (unsigned long long) run->npages);
+		if (extra)
+			printf(", \"dirty\": %llu, \"writeback\": %llu",
+			    rs.dirty, rs.writeback);
+		printf(" }");
+		return;
+	}
+
+	printf("\tSlice[%d]: %llu:%llu (%llu pages", sindex, start, end,
+	    (unsigned long long) run->npages);
+	if (extra)
+		printf(", %llu dirty, %llu under writeback", rs.dirty,
+		    rs.writeback);
+	printf(")\n");
+}
+
+
+void
+print_summary(unsigned long long pim, unsigned long long lip,
+    const struct residency_stat *rs)
+{
+	printf("\t%llu pages out of %llu appear to be in pagecache", pim, lip);
+	if (rs != NULL)
+		printf(", %llu dirty, %llu under writeback, %llu evicted "
+		    "(%llu recently)", rs->dirty, rs->writeback, rs->evicted,
+		    rs->recently_evicted);
+	printf("\n");
+}
+
+
+/* A bar of BAR_WIDTH characters, with eighths of blocks in UTF-8 */
+void
+print_bar(double frac, int utf8)
+{
+	static const char	*eighths[] = { "", "\u258f", "\u258e",
+	    "\u258d", "\u258c", "\u258b", "\u258a", "\u2589" };
+	int			 units, i;
+
+	if (!utf8) {
+		units = (int) (frac * BAR_WIDTH + 0.5);
+		for (i = 0; i < BAR_WIDTH; i++)
+			putchar(i < units ? '#' : '.');
+		return;
+	}
+
+	units = (int) (frac * BAR_WIDTH * 8 + 0.5);
+	for (i = 0; i < units / 8; i++)
+		fputs("\u2588", stdout);
+	fputs(eighths[units % 8], stdout);
+	for (i = units / 8 + (units % 8 != 0); i < BAR_WIDTH; i++)
+		putchar(' ');
+}
+
+
+/*
+ * Text heatmap: one line per bucket, then the number of slices (and their
+ * pages) by length, from the shortest slice to the longest.
+ */
+void
+print_heatmap(const struct heatmap *h, unsigned long long lip,
+    long int pagesize, int utf8)
+{
+	unsigned long long	 pgsz = (unsigned long long) pagesize;
+	unsigned long long	 b, n, maxpages = 0;
+	int			 k, first = -1, last = 0, iw, ow;
+	char			 buf[32];
+
+	/* Aligned bars */
+	iw = snprintf(buf, sizeof(buf), "%llu", h->nbuckets - 1);
+	ow = snprintf(buf, sizeof(buf), "%llu", lip * pgsz - 1);
+	for (b = 0; b < h->nbuckets; b++) {
+		n = b == h->nbuckets - 1 ? lip - b * h->bucket : h->bucket;
+		printf("\tBucket[%*llu]: %*llu:%*llu |", iw, b, ow,
+		    b * h->bucket * pgsz, ow, (b * h->bucket + n) * pgsz - 1);
+		print_bar((double) h->resident[b] / (double) n, utf8);
+		printf("| %5.1f%%\n", 100.0 * (double) h->resident[b]
+		    / (double) n);
+	}
+
+	for (k = 0; k < 64; k++) {
+		if (h->nslices[k] > 0 && first == -1)
+			first = k;
+		if (h->nslices[k] > 0)
+			last = k;
+		if (h->npages[k] > maxpages)
+			maxpages = h->npages[k];
+	}
+	if (first == -1)
+		return;
+	printf("\tSlices by length (pages):\n");
+	for (k = first; k <= last; k++) {
+		printf("\t%10llu-%-10llu %10llu slices %12llu pages |",
+		    1ULL << k, (2ULL << k) - 1, h->nslices[k], h->npages[k]);
+		print_bar((double) h->npages[k] / (double) maxpages, utf8);
+		printf("|\n");
+	}
+}
+
+
+/* Up to the slices (if 'slices') of the file, as they are found */
+void
+print_json_head(const struct snap_file *f, long int pagesize, int slices,
+    int first)
+{
+	printf("%s\n    { \"path\": ", first ? "" : ",");
+	print_string(f->path);
+	printf(", \"size\": %llu, \"mtime\": %lld, \"mtime_nsec\": %u,\n"
+	    "      \"inode\": %llu, \"pages\": %llu",
+	    (unsigned long long) f->size, (long long) f->mtime,
+	    (unsigned) f->mtime_nsec, (unsigned long long) f->ino,
+	    (unsigned long long) ((f->size + (unsigned long long) pagesize
+	    - 1) / (unsigned long long) pagesize));
+	if (slices)
+		printf(",\n      \"slices\": [");
+}
+
+
+/* The counts (& heatmap) once the file is scanned, 'rs' may be NULL */
+void
+print_json_tail(const struct slicer *sl, unsigned long long lip,
+    const struct residency_stat *rs)
 {
-	struct stat	 st;
-	void		*filemap = NULL;
-#ifdef __linux__
-	unsigned char	*pages = NULL;
+	const struct heatmap	*h = sl->heat;
+	unsigned long long	 b, n;
+	int			 k;
+
+	if (sl->show)
+		printf("%s]", sl->sindex > 0 ? "\n      " : " ");
+	printf(",\n      \"resident_pages\": %llu", sl->pim);
+	if (rs != NULL)
+		printf(", \"dirty_pages\": %llu, \"writeback_pages\": %llu,\n"
+		    "      \"evicted_pages\": %llu, "
+		    "\"recently_evicted_pages\": %llu", rs->dirty,
+		    rs->writeback, rs->evicted, rs->recently_evicted);
+	if (h != NULL) {
+		printf(",\n      \"bucket_size\": %llu, \"buckets\": [",
+		    h->bucket * (unsigned long long) sl->pagesize);
+		for (b = 0; b < h->nbuckets; b++) {
+			n = b == h->nbuckets - 1 ? lip - b * h->bucket
+			    : h->bucket;
+			printf("%s%.4f", b > 0 ? ", " : " ",
+			    (double) h->resident[b] / (double) n);
+		}
+		printf(" ],\n      \"slice_lengths\": [");
+		for (k = 0, n = 0; k < 64; k++) {
+			if (h->nslices[k] == 0)
+				continue;
+			printf("%s\n        { \"min_pages\": %llu, "
+			    "\"max_pages\": %llu, \"slices\": %llu, "
+			    "\"pages\": %llu }", n++ > 0 ? "," : "",
+			    1ULL << k, (2ULL << k) - 1, h->nslices[k],
+			    h->npages[k]);
+		}
+		printf("%s]", n > 0 ? "\n      " : " ");
+	}
+	printf(" }");
+}
+
+
+/*
+ * A number of buckets, or their size (with a K, M, G or T suffix) if
+ * '*size' is set.
+ */
+unsigned long long
+parse_buckets(const char *spec, int *size)
+{
+	unsigned long long n;
+
+	*size = spec[strspn(spec, "0123456789")] != '\0';
+	if (scan_size(spec, &n) == -1 || n == 0)
+		error(1, -1, "Invalid number or size of buckets: '%s'", spec);
+
+	return (n);
+}
+
+
+/* 'spec' buckets (or bytes per bucket if 'size') for 'lip' pages */
+void
+heat_init(struct heatmap *h, unsigned long long lip, unsigned long long spec,
+    int size, long int pagesize)
+{
+	memset(h, 0, sizeof(*h));
+	if (size)
+		h->bucket = (spec + (unsigned long long) pagesize - 1)
+		    / (unsigned long long) pagesize;
+	else
+		h->bucket = (lip + spec - 1) / spec;
+	if (h->bucket == 0)
+		h->bucket = 1;
+	h->nbuckets = (lip + h->bucket - 1) / h->bucket;
+	h->resident = calloc(h->nbuckets, sizeof(*h->resident));
+	if (h->resident == NULL)
+		error(1, errno, "Unable to allocate %llu buckets",
+		    h->nbuckets);
+}
+
+
+/* Slice of resident pages [start:start + n), in order */
+void
+heat_add(struct heatmap *h, unsigned long long start, unsigned long long n)
+{
+	unsigned long long	 b, k, v = n;
+	int			 l = 0;
+
+#if defined(__GNUC__)
+	l = 63 - __builtin_clzll(v);
 #else
-	char		*pages = NULL;
+	while (v >>= 1)
+		l++;
 #endif
-	size_t		 lip; /* lip: length in pages */
-	unsigned long	 pim, /* pim: pages in memory counter */ k;
-	long int	 pagesize, slice_start, slice_end;
-	int		 i, fd, in_a_slice, sindex;
+	h->nslices[l]++;
+	h->npages[l] += n;
 
-	pagesize = sysconf(_SC_PAGESIZE);
-	if (pagesize == -1)
-		error(1, errno, "Unable to get pagesize");
+	h->total += n;
+	while (n > 0) {
+		b = start / h->bucket;
+		k = (b + 1) * h->bucket - start;
+		if (k > n)
+			k = n;
+		h->resident[b] += k;
+		start += k;
+		n -= k;
+	}
+}
+
+
+/* Slice of resident pages [start:start + n), in order */
+void
+slice_add(void *arg, unsigned long long start, unsigned long long n)
+{
+	struct slicer	*sl = arg;
+	struct snap_run	 run;
+
+	sl->pim += n;
+	if (sl->heat != NULL)
+		heat_add(sl->heat, start, n);
+	if (sl->file != NULL && sl->error == 0
+	    && snapshot_add_run(sl->file, start, n) == -1)
+		sl->error = errno;
+	if (!sl->show)
+		return;
+
+	run.start = start;
+	run.npages = n;
+	print_slice(*sl->cachestat ? sl->fd : -1, sl->pagesize, sl->sindex++,
+	    &run, sl->json);
+}
+
+
+/*
+ * Follows the slices of the file with 'sl' (set up by the caller for what
+ * is done with them), returns 1 if 'rs' has the extra counts from
+ * cachestat(), 0 if not & -1 with errno set on failure.
+ * '*cachestat' is cleared when cachestat() turns out to be unavailable.
+ */
+int
+slice_file(struct residency *r, int fd, off_t size, struct slicer *sl,
+    int *cachestat, struct residency_stat *rs)
+{
+	int extra;
+
+	sl->pagesize = r->pagesize;
+	sl->fd = fd;
+	sl->cachestat = cachestat;
+	extra = residency_runs(r, fd, size, cachestat, rs, slice_add, sl);
+	if (extra != -1 && sl->error != 0) {
+		errno = sl->error;
+		extra = -1;
+	}
+
+	return (extra);
+}
+
+
+/* Snapshot of the current slices of the files in 'old' */
+void
+take_current(struct residency *r, const struct snapshot *old,
+    struct snapshot *cur, int *cachestat)
+{
+	struct residency_stat	 rs;
+	struct slicer		 sl;
+	struct stat		 st;
+	const char		*path;
+	size_t			 i;
+	int			 fd;
+
+	snapshot_init(cur, (uint32_t) r->pagesize);
+	for (i = 0; i < old->nfiles; i++) {
+		path = old->files[i].path;
+		fd = open(path, O_RDONLY);
+		if (fd == -1) {
+			warning(errno, "Unable to open '%s'", path);
+			continue;
+		}
+		if (fstat(fd, &st) == -1)
+			warning(errno, "Unable to stat '%s'", path);
+		else if (st.st_size > 0) {
+			memset(&sl, 0, sizeof(sl));
+			sl.file = snapshot_add_file(cur, path, &st);
+			if (sl.file == NULL)
+				error(1, errno, "Unable to record '%s'", path);
+			if (slice_file(r, fd, st.st_size, &sl, cachestat,
+			    &rs) == -1)
+				warning(errno, "Unable to get core info for "
+				    "'%s'", path);
+		}
+		if (close(fd) == -1)
+			warning(errno, "Problem closing '%s'", path);
+	}
+}
+
+
+/* 'a' or 'b' (not both) can be NULL for a file in only one snapshot */
+void
+compare(const struct snap_file *a, const struct snap_file *b,
+    struct change *c)
+{
+	struct snap_file	 none;
+
+	memset(&none, 0, sizeof(none));
+	memset(c, 0, sizeof(*c));
+	if (a == NULL)
+		c->status = "added";
+	else if (b == NULL)
+		c->status = "removed";
+	else if (!snapshot_same_file(a, b))
+		c->status = "modified";
 	else
-		printf("Pagesize is: %ld bytes.\n", pagesize);
+		c->status = "unchanged";
+
+	if (snapshot_subtract(b != NULL ? b : &none, a != NULL ? a : &none,
+	    &c->loaded) == -1
+	    || snapshot_subtract(a != NULL ? a : &none, b != NULL ? b : &none,
+	    &c->evicted) == -1)
+		error(1, errno, "Unable to compare snapshots");
+}
+
+
+void
+print_runs(const char *name, const struct snap_file *f, long int pagesize,
+    int json)
+{
+	size_t	i;
 
-	for (i = 1; i < argc; i++) {
+	if (json) {
+		printf(",\n      \"%s\": [", name);
+		for (i = 0; i < f->nruns; i++)
+			print_slice(-1, pagesize, (int) i, &f->runs[i], 1);
+		printf("%s]", f->nruns > 0 ? "\n      " : " ");
+		return;
+	}
+
+	for (i = 0; i < f->nruns; i++)
+		printf("\t%s[%lu]: %llu:%llu (%llu pages)\n", name,
+		    (unsigned long) i, (unsigned long long) (f->runs[i].start
+		    * (unsigned long long) pagesize),
+		    (unsigned long long) ((f->runs[i].start
+		    + f->runs[i].npages) * (unsigned long long) pagesize - 1),
+		    (unsigned long long) f->runs[i].npages);
+}
+
+
+void
+print_change(const struct change *c, const char *path, long int pagesize,
+    int json)
+{
+	if (json) {
+		printf("\n    { \"path\": ");
+		print_string(path);
+		printf(", \"status\": \"%s\",\n      \"loaded_pages\": %llu, "
+		    "\"evicted_pages\": %llu", c->status,
+		    (unsigned long long) snapshot_resident(&c->loaded),
+		    (unsigned long long) snapshot_resident(&c->evicted));
+		print_runs("loaded", &c->loaded, pagesize, 1);
+		print_runs("evicted", &c->evicted, pagesize, 1);
+		printf(" }");
+		return;
+	}
+
+	printf("'%s':", path);
+	if (strcmp(c->status, "unchanged") != 0)
+		printf(" %s", c->status);
+	printf("\n");
+	print_runs("Loaded", &c->loaded, pagesize, 0);
+	print_runs("Evicted", &c->evicted, pagesize, 0);
+	printf("\t%llu pages loaded, %llu pages evicted\n",
+	    (unsigned long long) snapshot_resident(&c->loaded),
+	    (unsigned long long) snapshot_resident(&c->evicted));
+}
+
+
+/*
+ * Files (matched by path) whose slices differ between the snapshots, or
+ * which are in only one of them.  Both snapshots are sorted.
+ */
+void
+diff(const struct snapshot *a, const struct snapshot *b, int json)
+{
+	const struct snap_file	*fa, *fb;
+	struct change		 c;
+	unsigned long long	 nfiles = 0, loaded = 0, evicted = 0;
+	size_t			 i = 0, j = 0;
+	int			 cmp;
+
+	if (json)
+		printf("{\n  \"pagesize\": %lu,\n  \"files\": [",
+		    (unsigned long) a->pagesize);
+	while (i < a->nfiles || j < b->nfiles) {
+		fa = i < a->nfiles ? &a->files[i] : NULL;
+		fb = j < b->nfiles ? &b->files[j] : NULL;
+		if (fa != NULL && fb != NULL)
+			cmp = strcmp(fa->path, fb->path);
+		else
+			cmp = fa != NULL ? -1 : 1;
+		if (cmp < 0) {
+			fb = NULL;
+			i++;
+		} else if (cmp > 0) {
+			fa = NULL;
+			j++;
+		} else {
+			i++;
+			j++;
+		}
+
+		compare(fa, fb, &c);
+		if (strcmp(c.status, "unchanged") != 0 || c.loaded.nruns > 0
+		    || c.evicted.nruns > 0) {
+			if (json && nfiles > 0)
+				putchar(',');
+			print_change(&c, fa != NULL ? fa->path : fb->path,
+			    (long int) a->pagesize, json);
+			nfiles++;
+			loaded += snapshot_resident(&c.loaded);
+			evicted += snapshot_resident(&c.evicted);
+		}
+		snapshot_free_file(&c.loaded);
+		snapshot_free_file(&c.evicted);
+	}
+
+	if (json)
+		printf("%s],\n  \"files_changed\": %llu, \"loaded_pages\": "
+		    "%llu, \"evicted_pages\": %llu\n}\n", nfiles > 0 ? "\n  "
+		    : " ", nfiles, loaded, evicted);
+	else
+		printf("%llu files changed, %llu pages loaded, %llu pages "
+		    "evicted\n", nfiles, loaded, evicted);
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct residency_stat	 rs;
+	struct snapshot		 snap, old;
+	struct snap_file	 local, *f;
+	struct heatmap		 heat;
+	struct slicer		 sl;
+	struct stat		 st;
+	struct residency	 r;
+	const char		*base = NULL, *output = NULL;
+	unsigned long long	 buckets = 0, lip;
+	int			 i, fd, ch, extra, json = 0, cachestat = 1;
+	int			 nshown = 0, bsize = 0, utf8;
+
+	while ((ch = getopt(argc, argv, ":d:hH:JMo:")) != -1) {
+		switch (ch) {
+		case 'd':
+			base = optarg;
+			break;
+		case 'H':
+			buckets = parse_buckets(optarg, &bsize);
+			break;
+		case 'h':
+			usage(stdout);
+			exit(0);
+		case 'J':
+			json = 1;
+			break;
+		case 'M':
+			cachestat = 0;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case ':':
+			usage(stderr);
+			error(1, -1, "Option -%c requires an argument",
+			    optopt);
+			break;
+		default:
+			usage(stderr);
+			error(1, -1, "Unknown option: -%c", optopt);
+			break;
+		}
+	}
+	if (json && output != NULL && strcmp(output, "-") == 0)
+		error(1, -1, "JSON & the snapshot can not both go to the "
+		    "standard output");
+	if (base != NULL && (argc - optind > 1
+	    || (argc - optind == 1 && output != NULL))) {
+		usage(stderr);
+		error(1, -1, "Too many snapshots");
+	}
+	if (buckets > 0 && (base != NULL || output != NULL))
+		error(1, -1, "A heatmap can not be saved in a snapshot");
+
+	/* Blocks of eighths for the bars if the terminal can display them */
+	setlocale(LC_CTYPE, "");
+	utf8 = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+
+	if (residency_init(&r) == -1)
+		error(1, errno, "Unable to get pagesize");
+	snapshot_init(&snap, (uint32_t) r.pagesize);
+
+	if (base != NULL) {
+		if (snapshot_read(&old, base) == -1)
+			error(1, errno, "Unable to read snapshot '%s'", base);
+		if (optind < argc) {
+			if (snapshot_read(&snap, argv[optind]) == -1)
+				error(1, errno, "Unable to read snapshot "
+				    "'%s'", argv[optind]);
+			if (snap.pagesize != old.pagesize)
+				error(1, -1, "Snapshots with different page "
+				    "sizes (%lu & %lu bytes)",
+				    (unsigned long) old.pagesize,
+				    (unsigned long) snap.pagesize);
+		} else if (old.pagesize != (uint32_t) r.pagesize)
+			error(1, -1, "Snapshot of pages of %lu bytes, not %ld",
+			    (unsigned long) old.pagesize, r.pagesize);
+		else
+			take_current(&r, &old, &snap, &cachestat);
+
+		if (output != NULL && snapshot_write(&snap, output) == -1)
+			error(1, errno, "Unable to save snapshot '%s'",
+			    output);
+		snapshot_sort(&old);
+		snapshot_sort(&snap);
+		if (output == NULL || strcmp(output, "-") != 0)
+			diff(&old, &snap, json);
+		snapshot_free(&old);
+		snapshot_free(&snap);
+		return (0);
+	}
+
+	if (json)
+		printf("{\n  \"pagesize\": %ld,\n  \"files\": [", r.pagesize);
+	else if (output == NULL)
+		printf("Pagesize is: %ld bytes.\n", r.pagesize);
+
+	for (i = optind; i < argc; i++) {
 		fd = open(argv[i], O_RDONLY);
-		if (fd != -1) {
-			if (fstat(fd, &st) == -1) {
-				warning(errno, "Unable to stat '%s'", argv[i]);
-				continue;
+		if (fd == -1) {
+			warning(errno, "Unable to open '%s'", argv[i]);
+			continue;
+		}
+		if (fstat(fd, &st) == -1)
+			warning(errno, "Unable to stat '%s'", argv[i]);
+		else if (st.st_size > 0) {
+			/* Only the file itself unless saved in the snapshot */
+			if (output != NULL)
+				f = snapshot_add_file(&snap, argv[i], &st);
+			else
+				f = snapshot_file_init(&local, argv[i], &st)
+				    == 0 ? &local : NULL;
+			if (f == NULL)
+				error(1, errno, "Unable to record '%s'",
+				    argv[i]);
+
+			memset(&sl, 0, sizeof(sl));
+			sl.file = output != NULL ? f : NULL;
+			sl.json = json;
+			sl.show = buckets == 0 && (json || output == NULL);
+			lip = (unsigned long long) ((st.st_size + r.pagesize
+			    - 1) / r.pagesize);
+			if (buckets > 0) {
+				sl.heat = &heat;
+				heat_init(&heat, lip, buckets, bsize,
+				    r.pagesize);
 			}
-			if (st.st_size > 0) {
-				filemap = mmap(NULL, st.st_size, PROT_READ,
-				    MAP_SHARED, fd, 0);
-				if (filemap == MAP_FAILED) {
-					warning(errno, "Unable to map '%s'",
-					    argv[i]);
-					continue;
-				}
-				lip = (st.st_size + pagesize - 1) / pagesize;
-				pages = malloc(lip);
-				if (pages == NULL)
-					error(2, errno, "Unable to allocate "
-					    "pages[%lu]", (unsigned long) lip);
-
-				if (mincore(filemap, st.st_size, pages) == -1) {
-					warning(errno, "Unable to get core info"
-					    " for '%s'", argv[i]);
-					continue;
-				}
-				pim = 0;
-				sindex = slice_start = slice_end = in_a_slice = 0;
+
+			if (json)
+				print_json_head(f, r.pagesize, sl.show,
+				    nshown++ == 0);
+			else if (output == NULL)
 				printf("'%s':\n", argv[i]);
-				for (k = 0; k < lip; k++) {
-					if (pages[k] & 1) {
-						if (!in_a_slice) {
-							in_a_slice = 1;
-							slice_start = pagesize
-							    * k;
-							slice_end = slice_start
-							    + pagesize - 1;
-						} else {
-							slice_end += pagesize;
-						}
-						pim++;
-					} else if (in_a_slice) {
-						in_a_slice = 0;
-						print_slice(sindex, pagesize,
-						    slice_start, slice_end);
-						sindex++;
-					}
-				}
-				if (in_a_slice) {
-				/* last page of the file in pagecache ? */
-					print_slice(sindex, pagesize,
-					    slice_start, slice_end);
-				}
-				printf("\t%lu pages out of %lu appear to be in "
-				    "pagecache\n", pim, (unsigned long) lip);
-
-				free(pages);
-				pages = NULL;
-
-				if (munmap(filemap, st.st_size) == -1) {
-					warning(errno, "Unable to unmap '%s'",
-					    argv[i]);
-					continue;
-				}
-			}
-			if (close(fd) == -1)
-				warning(errno, "Problem closing '%s'", argv[i]);
-		} else {
-			warning(errno, "Unable to open '%s'", argv[i]);
+			extra = slice_file(&r, fd, st.st_size, &sl,
+			    &cachestat, &rs);
+			if (extra == -1)
+				warning(errno, "Unable to get core info for "
+				    "'%s'", argv[i]);
+			if (json)
+				print_json_tail(&sl, lip, extra == 1 ? &rs
+				    : NULL);
+			else if (extra != -1 && sl.heat != NULL) {
+				print_heatmap(&heat, lip, r.pagesize, utf8);
+				print_summary(sl.pim, lip, extra ? &rs : NULL);
+			} else if (extra != -1 && output == NULL)
+				print_summary(sl.pim, lip, extra ? &rs : NULL);
+			if (sl.heat != NULL)
+				free(heat.resident);
+			if (f == &local)
+				snapshot_free_file(&local);
 		}
+		if (close(fd) == -1)
+			warning(errno, "Problem closing '%s'", argv[i]);
 	}
+
+	if (json)
+		printf("\n  ]\n}\n");
+	if (output != NULL && snapshot_write(&snap, output) == -1)
+		error(1, errno, "Unable to save snapshot '%s'", output);
+	snapshot_free(&snap);
+
 	return (0);
 }
-
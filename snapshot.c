@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pagecache residency snapshots.  The binary format starts with a magic
+ * string ("CTSNAPSH") followed by unsigned LEB128 numbers: the version, the
+ * page size, then for each file the length of its path, the path (no
+ * terminating NUL), its size, mtime (seconds & nanoseconds), device, inode,
+ * number of runs of resident pages & for each run the number of pages from
+ * the end of the previous run (or the start of the file) & its length.
+ * A snapshot of files mostly (or not at all) in the pagecache takes a few
+ * bytes per file.
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "residency.h"
+#include "snapshot.h"
+
+static const char	snap_magic[8] = { 'C', 'T', 'S', 'N', 'A', 'P', 'S', 'H' };
+static const uint64_t	snap_version = 1;
+
+static int put_num(FILE *, uint64_t);
+static int get_num(FILE *, uint64_t *);
+static int read_file(struct snapshot *, FILE *, uint64_t);
+static int filecmp(const void *, const void *);
+static void scan_run(void *, unsigned long long, unsigned long long);
+
+/* Runs of resident pages being recorded */
+struct scanner {
+	struct snap_file	*file;
+	int			 error;
+};
+
+
+void
+snapshot_init(struct snapshot *s, uint32_t pagesize)
+{
+	memset(s, 0, sizeof(*s));
+	s->pagesize = pagesize;
+}
+
+
+/* A file without runs, returns 0 or -1 with errno set */
+int
+snapshot_file_init(struct snap_file *f, const char *path,
+    const struct stat *st)
+{
+	memset(f, 0, sizeof(*f));
+	f->path = strdup(path);
+	if (f->path == NULL)
+		return (-1);
+	f->size = (uint64_t) st->st_size;
+	f->mtime = (int64_t) st->st_mtime;
+#ifdef __linux__
+	f->mtime_nsec = (uint32_t) st->st_mtim.tv_nsec;
+#endif /* __linux__ */
+	f->dev = (uint64_t) st->st_dev;
+	f->ino = (uint64_t) st->st_ino;
+
+	return (0);
+}
+
+
+/* Returns the new file (without runs), NULL with errno set on failure */
+struct snap_file *
+snapshot_add_file(struct snapshot *s, const char *path, const struct stat *st)
+{
+	struct snap_file	f;
+
+	if (snapshot_file_init(&f, path, st) == -1)
+		return (NULL);
+	if (snapshot_add(s, &f) == -1) {
+		snapshot_free_file(&f);
+		return (NULL);
+	}
+
+	return (&s->files[s->nfiles - 1]);
+}
+
+
+/*
+ * Moves 'f' (from snapshot_file_init()) to the snapshot, returns 0 or -1
+ * with errno set ('f' is then left as is).
+ */
+int
+snapshot_add(struct snapshot *s, struct snap_file *f)
+{
+	struct snap_file	*files;
+	size_t			 n;
+
+	if (s->nfiles == s->alloc) {
+		n = s->alloc ? s->alloc * 2 : 64;
+		files = realloc(s->files, n * sizeof(*files));
+		if (files == NULL)
+			return (-1);
+		s->files = files;
+		s->alloc = n;
+	}
+	s->files[s->nfiles++] = *f;
+	memset(f, 0, sizeof(*f));
+
+	return (0);
+}
+
+
+/* Runs are added in order, adjacent ones are merged */
+int
+snapshot_add_run(struct snap_file *f, uint64_t start, uint64_t npages)
+{
+	struct snap_run	*r;
+	size_t		 n;
+
+	if (npages == 0)
+		return (0);
+	if (f->nruns > 0) {
+		r = &f->runs[f->nruns - 1];
+		if (r->start + r->npages == start) {
+			r->npages += npages;
+			return (0);
+		}
+	}
+
+	if (f->nruns == f->alloc) {
+		n = f->alloc ? f->alloc * 2 : 16;
+		r = realloc(f->runs, n * sizeof(*r));
+		if (r == NULL)
+			return (-1);
+		f->runs = r;
+		f->alloc = n;
+	}
+	f->runs[f->nruns].start = start;
+	f->runs[f->nruns].npages = npages;
+	f->nruns++;
+
+	return (0);
+}
+
+
+uint64_t
+snapshot_resident(const struct snap_file *f)
+{
+	uint64_t	 n = 0;
+	size_t		 i;
+
+	for (i = 0; i < f->nruns; i++)
+		n += f->runs[i].npages;
+
+	return (n);
+}
+
+
+/*
+ * Whether both are (likely) the same, unmodified, file: the device is not
+ * compared, it may change across reboots or remounts
+ */
+int
+snapshot_same_file(const struct snap_file *a, const struct snap_file *b)
+{
+	return (a->size == b->size && a->mtime == b->mtime
+	    && a->mtime_nsec == b->mtime_nsec && a->ino == b->ino);
+}
+
+
+/*
+ * The runs of 'a' not in 'b', into 'd' (which should be empty), returns 0
+ * or -1 with errno set.
+ */
+int
+snapshot_subtract(const struct snap_file *a, const struct snap_file *b,
+    struct snap_file *d)
+{
+	uint64_t	 start, end, bstart, bend;
+	size_t		 i, j = 0;
+
+	for (i = 0; i < a->nruns; i++) {
+		start = a->runs[i].start;
+		end = start + a->runs[i].npages;
+
+		/* The runs of 'b' entirely before this one are done with */
+		while (j < b->nruns
+		    && b->runs[j].start + b->runs[j].npages <= start)
+			j++;
+
+		while (start < end && j < b->nruns
+		    && b->runs[j].start < end) {
+			bstart = b->runs[j].start;
+			bend = bstart + b->runs[j].npages;
+			if (bstart > start
+			    && snapshot_add_run(d, start, bstart - start) == -1)
+				return (-1);
+			if (bend >= end) {
+				start = end;
+				break;
+			}
+			start = bend;
+			j++;
+		}
+		if (start < end
+		    && snapshot_add_run(d, start, end - start) == -1)
+			return (-1);
+	}
+
+	return (0);
+}
+
+
+/*
+ * Records the resident pages of the file opened as 'fd' in 'f', returns 0
+ * or -1 with errno set.  Files entirely (or not at all) in the pagecache
+ * are not mapped if '*cachestat', which is cleared when cachestat() turns
+ * out to be unavailable.
+ */
+int
+snapshot_scan(struct residency *r, int fd, struct snap_file *f,
+    int *cachestat)
+{
+	struct residency_stat	 rs;
+	struct scanner		 sc;
+
+	sc.file = f;
+	sc.error = 0;
+	if (residency_runs(r, fd, (off_t) f->size, cachestat, &rs, scan_run,
+	    &sc) == -1)
+		return (-1);
+	if (sc.error != 0) {
+		errno = sc.error;
+		return (-1);
+	}
+
+	return (0);
+}
+
+
+/* By path, to match the files of two snapshots */
+void
+snapshot_sort(struct snapshot *s)
+{
+	qsort(s->files, s->nfiles, sizeof(*s->files), filecmp);
+}
+
+
+/* "-" is the standard output, returns 0 or -1 with errno set */
+int
+snapshot_write(const struct snapshot *s, const char *path)
+{
+	const struct snap_file	*f;
+	FILE			*fp;
+	uint64_t		 prev;
+	size_t			 i, k, len;
+	int			 rc = 0;
+
+	fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+	if (fp == NULL)
+		return (-1);
+
+	if (fwrite(snap_magic, sizeof(snap_magic), 1, fp) != 1
+	    || put_num(fp, snap_version) == -1
+	    || put_num(fp, s->pagesize) == -1)
+		rc = -1;
+
+	for (i = 0; rc == 0 && i < s->nfiles; i++) {
+		f = &s->files[i];
+		len = strlen(f->path);
+		if (put_num(fp, len) == -1
+		    || fwrite(f->path, 1, len, fp) != len
+		    || put_num(fp, f->size) == -1
+		    || put_num(fp, (uint64_t) f->mtime) == -1
+		    || put_num(fp, f->mtime_nsec) == -1
+		    || put_num(fp, f->dev) == -1
+		    || put_num(fp, f->ino) == -1
+		    || put_num(fp, f->nruns) == -1) {
+			rc = -1;
+			break;
+		}
+		for (k = 0, prev = 0; rc == 0 && k < f->nruns; k++) {
+			if (put_num(fp, f->runs[k].start - prev) == -1
+			    || put_num(fp, f->runs[k].npages) == -1)
+				rc = -1;
+			prev = f->runs[k].start + f->runs[k].npages;
+		}
+	}
+
+	if (fp == stdout) {
+		if (fflush(fp) == EOF)
+			rc = -1;
+	} else if (fclose(fp) == EOF)
+		rc = -1;
+
+	return (rc);
+}
+
+
+/*
+ * Reads a snapshot into 's' (initialized by this function), "-" is the
+ * standard input, returns 0 or -1 with errno set (EINVAL for something which
+ * is not a snapshot or is truncated).
+ */
+int
+snapshot_read(struct snapshot *s, const char *path)
+{
+	FILE		*fp;
+	char		 magic[sizeof(snap_magic)];
+	uint64_t	 v, pagesize;
+	int		 c, rc = 0, serrno;
+
+	snapshot_init(s, 0);
+	fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	if (fp == NULL)
+		return (-1);
+
+	if (fread(magic, sizeof(magic), 1, fp) != 1
+	    || memcmp(magic, snap_magic, sizeof(magic)) != 0
+	    || get_num(fp, &v) == -1 || v != snap_version
+	    || get_num(fp, &pagesize) == -1 || pagesize == 0
+	    || pagesize > UINT32_MAX) {
+		errno = ferror(fp) ? EIO : EINVAL;
+		rc = -1;
+	}
+	s->pagesize = (uint32_t) pagesize;
+
+	/* Files until the end of the snapshot */
+	while (rc == 0 && (c = getc(fp)) != EOF) {
+		ungetc(c, fp);
+		if (get_num(fp, &v) == -1 || read_file(s, fp, v) == -1)
+			rc = -1;
+	}
+	if (rc == 0 && ferror(fp)) {
+		errno = EIO;
+		rc = -1;
+	}
+
+	serrno = errno;
+	if (fp != stdin)
+		fclose(fp);
+	if (rc == -1) {
+		snapshot_free(s);
+		errno = serrno;
+	}
+
+	return (rc);
+}
+
+
+void
+snapshot_free_file(struct snap_file *f)
+{
+	free(f->path);
+	free(f->runs);
+	memset(f, 0, sizeof(*f));
+}
+
+
+void
+snapshot_free(struct snapshot *s)
+{
+	size_t i;
+
+	for (i = 0; i < s->nfiles; i++)
+		snapshot_free_file(&s->files[i]);
+	free(s->files);
+	memset(s, 0, sizeof(*s));
+}
+
+
+/* Unsigned LEB128: 7 bits per byte, least significant first */
+int
+put_num(FILE *fp, uint64_t v)
+{
+	int c;
+
+	do {
+		c = (int) (v & 0x7f);
+		v >>= 7;
+		if (v != 0)
+			c |= 0x80;
+		if (putc(c, fp) == EOF)
+			return (-1);
+	} while (v != 0);
+
+	return (0);
+}
+
+
+int
+get_num(FILE *fp, uint64_t *v)
+{
+	int	shift, c;
+
+	*v = 0;
+	for (shift = 0; shift < 64; shift += 7) {
+		c = getc(fp);
+		if (c == EOF) {
+			errno = ferror(fp) ? EIO : EINVAL;
+			return (-1);
+		}
+		*v |= (uint64_t) (c & 0x7f) << shift;
+		if ((c & 0x80) == 0)
+			return (0);
+	}
+	errno = EINVAL;
+
+	return (-1);
+}
+
+
+/* The rest of a file record, after the length of its path */
+int
+read_file(struct snapshot *s, FILE *fp, uint64_t len)
+{
+	struct snap_file	*f;
+	struct stat		 st;
+	char			*path;
+	uint64_t		 mtime, nsec, nruns, gap, npages, prev = 0, k;
+
+	if (len == 0 || len > 65536) {
+		errno = EINVAL;
+		return (-1);
+	}
+	path = malloc((size_t) len + 1);
+	if (path == NULL)
+		return (-1);
+	if (fread(path, 1, (size_t) len, fp) != (size_t) len) {
+		free(path);
+		errno = ferror(fp) ? EIO : EINVAL;
+		return (-1);
+	}
+	path[len] = '\0';
+
+	memset(&st, 0, sizeof(st));
+	f = snapshot_add_file(s, path, &st);
+	free(path);
+	if (f == NULL)
+		return (-1);
+
+	if (get_num(fp, &f->size) == -1 || get_num(fp, &mtime) == -1
+	    || get_num(fp, &nsec) == -1 || get_num(fp, &f->dev) == -1
+	    || get_num(fp, &f->ino) == -1 || get_num(fp, &nruns) == -1)
+		return (-1);
+	f->mtime = (int64_t) mtime;
+	f->mtime_nsec = (uint32_t) nsec;
+
+	for (k = 0; k < nruns; k++) {
+		if (get_num(fp, &gap) == -1 || get_num(fp, &npages) == -1)
+			return (-1);
+		if (snapshot_add_run(f, prev + gap, npages) == -1)
+			return (-1);
+		prev += gap + npages;
+	}
+
+	return (0);
+}
+
+
+void
+scan_run(void *arg, unsigned long long start, unsigned long long npages)
+{
+	struct scanner *sc = arg;
+
+	if (sc->error == 0 && snapshot_add_run(sc->file, start, npages) == -1)
+		sc->error = errno;
+}
+
+
+int
+filecmp(const void *a, const void *b)
+{
+	const struct snap_file *fa = a, *fb = b;
+
+	return (strcmp(fa->path, fb->path));
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Pagecache residency snapshots: for each file its identity (size, mtime,
+ * device & inode) & the runs of resident pages, in a compact binary format,
+ * & the differences between two snapshots.
+ */
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <sys/stat.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "residency.h"
+
+/* Resident pages [start:start + npages) */
+struct snap_run {
+	uint64_t		 start;
+	uint64_t		 npages;
+};
+
+struct snap_file {
+	char			*path;
+	uint64_t		 size;
+	int64_t			 mtime;		/* s */
+	uint32_t		 mtime_nsec;
+	uint64_t		 dev;
+	uint64_t		 ino;
+	struct snap_run		*runs;		/* in order, not adjacent */
+	size_t			 nruns;
+	size_t			 alloc;
+};
+
+struct snapshot {
+	uint32_t		 pagesize;
+	struct snap_file	*files;
+	size_t			 nfiles;
+	size_t			 alloc;
+};
+
+extern void snapshot_init(struct snapshot *, uint32_t);
+extern int snapshot_file_init(struct snap_file *, const char *,
+    const struct stat *);
+extern struct snap_file *snapshot_add_file(struct snapshot *, const char *,
+    const struct stat *);
+extern int snapshot_add(struct snapshot *, struct snap_file *);
+extern int snapshot_add_run(struct snap_file *, uint64_t, uint64_t);
+extern uint64_t snapshot_resident(const struct snap_file *);
+extern int snapshot_same_file(const struct snap_file *,
+    const struct snap_file *);
+extern int snapshot_subtract(const struct snap_file *,
+    const struct snap_file *, struct snap_file *);
+extern int snapshot_scan(struct residency *, int, struct snap_file *, int *);
+extern void snapshot_sort(struct snapshot *);
+extern int snapshot_write(const struct snapshot *, const char *);
+extern int snapshot_read(struct snapshot *, const char *);
+extern void snapshot_free_file(struct snap_file *);
+extern void snapshot_free(struct snapshot *);
+
+#endif /* __SNAPSHOT_H__ */
@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * I/O traces.
+ *
+ * Binary traces, in host byte order: the "HRRTRACE" magic, a 32 bits
+ * version, the number of paths (32 bits) & the paths (32 bits length &
+ * bytes, no terminating NUL), the number of records (64 bits) then the
+ * records themselves (struct trace_rec, 24 bytes each).
+ *
+ * Text traces (e.g. derived from strace output or application logs) have one
+ * read per line: "[time,]path,offset,size", fields separated by commas or
+ * blanks (paths can not contain either), time in seconds (any origin, e.g.
+ * the epoch).  Lines without a time are replayed right after the previous
+ * read (as fast as possible if no line has a time), empty lines & lines
+ * starting with '#' are ignored.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errwarn.h"
+#include "trace.h"
+
+static const char	trace_magic[8] = { 'H', 'R', 'R', 'T', 'R', 'A', 'C', 'E' };
+static const uint32_t	trace_version = 1;
+
+static size_t path_hash(const char *);
+static int path_rehash(struct trace *, size_t);
+static int reccmp(const void *, const void *);
+static int read_binary(struct trace *, FILE *);
+static int read_text(struct trace *, FILE *, const char *);
+
+
+void
+trace_init(struct trace *tr)
+{
+	memset(tr, 0, sizeof(*tr));
+}
+
+
+int
+trace_add(struct trace *tr, uint32_t file, off_t offset, size_t size,
+    uint64_t ts)
+{
+	struct trace_rec *r;
+
+	if (tr->nrecs == tr->alloc) {
+		size_t n = tr->alloc ? tr->alloc * 2 : 4096;
+
+		r = realloc(tr->recs, n * sizeof(*r));
+		if (r == NULL)
+			return (-1);
+		tr->recs = r;
+		tr->alloc = n;
+	}
+
+	r = &tr->recs[tr->nrecs++];
+	r->ts = ts;
+	r->offset = (uint64_t) offset;
+	r->file = file;
+	r->size = (uint32_t) size;
+
+	return (0);
+}
+
+
+/* FNV-1a */
+size_t
+path_hash(const char *path)
+{
+	const unsigned char	*p;
+	uint64_t		 h = 14695981039346656037ULL;
+
+	for (p = (const unsigned char *) path; *p != '\0'; p++) {
+		h ^= *p;
+		h *= 1099511628211ULL;
+	}
+
+	return ((size_t) h);
+}
+
+
+/* Rebuilds the paths hash table with 'size' slots */
+int
+path_rehash(struct trace *tr, size_t size)
+{
+	uint32_t	*h;
+	size_t		 i, s;
+
+	h = calloc(size, sizeof(*h));
+	if (h == NULL)
+		return (-1);
+
+	for (i = 0; i < tr->npaths; i++) {
+		s = path_hash(tr->paths[i]) & (size - 1);
+		while (h[s] != 0)
+			s = (s + 1) & (size - 1);
+		h[s] = (uint32_t) i + 1;
+	}
+
+	free(tr->phash);
+	tr->phash = h;
+	tr->phsize = size;
+
+	return (0);
+}
+
+
+/* Returns the index of 'path' in the paths table, adding it if needed */
+int
+trace_path(struct trace *tr, const char *path)
+{
+	size_t s;
+
+	/* At most half full */
+	if (2 * (tr->npaths + 1) > tr->phsize && path_rehash(tr,
+	    tr->phsize ? tr->phsize * 2 : 128) == -1)
+		return (-1);
+
+	s = path_hash(path) & (tr->phsize - 1);
+	for (; tr->phash[s] != 0; s = (s + 1) & (tr->phsize - 1)) {
+		if (strcmp(tr->paths[tr->phash[s] - 1], path) == 0)
+			return ((int) tr->phash[s] - 1);
+	}
+
+	if (tr->npaths == tr->palloc) {
+		size_t	  n = tr->palloc ? tr->palloc * 2 : 64;
+		char	**p;
+
+		p = realloc(tr->paths, n * sizeof(*p));
+		if (p == NULL)
+			return (-1);
+		tr->paths = p;
+		tr->palloc = n;
+	}
+	tr->paths[tr->npaths] = strdup(path);
+	if (tr->paths[tr->npaths] == NULL)
+		return (-1);
+	tr->phash[s] = (uint32_t) tr->npaths + 1;
+
+	return ((int) tr->npaths++);
+}
+
+
+/* Appends the records of 'src' (with the same paths table) to 'dst' */
+int
+trace_merge(struct trace *dst, const struct trace *src)
+{
+	const struct trace_rec	*r;
+	size_t			 i;
+
+	for (i = 0; i < src->nrecs; i++) {
+		r = &src->recs[i];
+		if (trace_add(dst, r->file, (off_t) r->offset, r->size,
+		    r->ts) == -1)
+			return (-1);
+	}
+
+	return (0);
+}
+
+
+int
+reccmp(const void *a, const void *b)
+{
+	const struct trace_rec *ra = a, *rb = b;
+
+	if (ra->ts != rb->ts)
+		return (ra->ts < rb->ts ? -1 : 1);
+	if (ra->file != rb->file)
+		return (ra->file < rb->file ? -1 : 1);
+	if (ra->offset != rb->offset)
+		return (ra->offset < rb->offset ? -1 : 1);
+
+	return (0);
+}
+
+
+/* Sorts the records by time & makes the times relative to the first one */
+void
+trace_sort(struct trace *tr)
+{
+	size_t i;
+
+	if (tr->nrecs == 0)
+		return;
+
+	qsort(tr->recs, tr->nrecs, sizeof(*tr->recs), reccmp);
+	for (i = tr->nrecs; i > 0; i--)
+		tr->recs[i - 1].ts -= tr->recs[0].ts;
+}
+
+
+int
+trace_write(const struct trace *tr, const char *path)
+{
+	FILE		*fp;
+	uint64_t	 n = tr->nrecs;
+	uint32_t	 v;
+	size_t		 i;
+	int		 rc = 0;
+
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return (-1);
+
+	v = (uint32_t) tr->npaths;
+	if (fwrite(trace_magic, sizeof(trace_magic), 1, fp) != 1
+	    || fwrite(&trace_version, sizeof(trace_version), 1, fp) != 1
+	    || fwrite(&v, sizeof(v), 1, fp) != 1)
+		rc = -1;
+
+	for (i = 0; rc == 0 && i < tr->npaths; i++) {
+		v = (uint32_t) strlen(tr->paths[i]);
+		if (fwrite(&v, sizeof(v), 1, fp) != 1
+		    || fwrite(tr->paths[i], 1, v, fp) != v)
+			rc = -1;
+	}
+
+	if (rc == 0 && (fwrite(&n, sizeof(n), 1, fp) != 1
+	    || fwrite(tr->recs, sizeof(*tr->recs), tr->nrecs, fp)
+	    != tr->nrecs))
+		rc = -1;
+
+	if (fclose(fp) == EOF)
+		rc = -1;
+
+	return (rc);
+}
+
+
+int
+read_binary(struct trace *tr, FILE *fp)
+{
+	char		*p;
+	uint64_t	 n;
+	uint32_t	 v, npaths, len, i;
+
+	if (fread(&v, sizeof(v), 1, fp) != 1
+	    || fread(&npaths, sizeof(npaths), 1, fp) != 1)
+		goto truncated;
+	if (v != trace_version) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	for (i = 0; i < npaths; i++) {
+		if (fread(&len, sizeof(len), 1, fp) != 1)
+			goto truncated;
+		p = malloc((size_t) len + 1);
+		if (p == NULL)
+			return (-1);
+		if (fread(p, 1, len, fp) != len) {
+			free(p);
+			goto truncated;
+		}
+		p[len] = '\0';
+		if (trace_path(tr, p) != (int) i) {
+			free(p);
+			errno = EINVAL;
+			return (-1);
+		}
+		free(p);
+	}
+
+	if (fread(&n, sizeof(n), 1, fp) != 1)
+		goto truncated;
+
+	if (n > SIZE_MAX / sizeof(*tr->recs)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	tr->recs = malloc((size_t) n * sizeof(*tr->recs));
+	if (n > 0 && tr->recs == NULL)
+		return (-1);
+	tr->alloc = (size_t) n;
+	tr->nrecs = fread(tr->recs, sizeof(*tr->recs), (size_t) n, fp);
+	if (tr->nrecs != n)
+		goto truncated;
+
+	for (n = 0; n < tr->nrecs; n++) {
+		if (tr->recs[n].file >= npaths) {
+			errno = EINVAL;
+			return (-1);
+		}
+	}
+
+	return (0);
+
+truncated:
+	errno = ferror(fp) ? EIO : EINVAL;
+	return (-1);
+}
+
+
+int
+read_text(struct trace *tr, FILE *fp, const char *path)
+{
+	char			 line[4096], *f[4], *s;
+	unsigned long		 lineno = 0;
+	unsigned long long	 offset, size;
+	double			 t, last = 0.0;
+	size_t			 i;
+	int			 nf, idx, timed = 0;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		for (nf = 0, s = strtok(line, ", \t\r\n"); s != NULL && nf < 4;
+		    s = strtok(NULL, ", \t\r\n"))
+			f[nf++] = s;
+		if (nf == 0 || f[0][0] == '#')
+			continue;
+		if (nf < 3 || s != NULL) {
+			warning(-1, "%s:%lu: invalid trace line, ignored", path,
+			    lineno);
+			continue;
+		}
+
+		t = nf == 4 ? strtod(f[0], NULL) : last;
+		offset = strtoull(f[nf - 2], NULL, 0);
+		size = strtoull(f[nf - 1], NULL, 0);
+		if (t < 0.0 || size == 0 || size > UINT32_MAX) {
+			warning(-1, "%s:%lu: invalid time or size, ignored",
+			    path, lineno);
+			continue;
+		}
+
+		/* The untimed lines before the first timed one go with it */
+		if (nf == 4 && !timed) {
+			for (i = 0; i < tr->nrecs; i++)
+				tr->recs[i].ts = (uint64_t) (t * 1e9);
+			timed = 1;
+		}
+		last = t;
+
+		idx = trace_path(tr, f[nf - 3]);
+		if (idx == -1 || trace_add(tr, (uint32_t) idx, (off_t) offset,
+		    (size_t) size, (uint64_t) (t * 1e9)) == -1)
+			return (-1);
+	}
+	if (ferror(fp)) {
+		errno = EIO;
+		return (-1);
+	}
+
+	return (0);
+}
+
+
+/*
+ * Reads a binary or text trace ("-" for a text trace on the standard input),
+ * the records are sorted by time.
+ */
+int
+trace_read(struct trace *tr, const char *path)
+{
+	FILE	*fp;
+	char	 magic[sizeof(trace_magic)];
+	int	 rc, serrno;
+
+	if (strcmp(path, "-") == 0)
+		rc = read_text(tr, stdin, "<stdin>");
+	else {
+		fp = fopen(path, "r");
+		if (fp == NULL)
+			return (-1);
+
+		if (fread(magic, sizeof(magic), 1, fp) == 1
+		    && memcmp(magic, trace_magic, sizeof(magic)) == 0)
+			rc = read_binary(tr, fp);
+		else {
+			rewind(fp);
+			rc = read_text(tr, fp, path);
+		}
+		serrno = errno;
+		fclose(fp);
+		errno = serrno;
+	}
+
+	if (rc == 0)
+		trace_sort(tr);
+
+	return (rc);
+}
+
+
+void
+trace_free(struct trace *tr)
+{
+	size_t i;
+
+	for (i = 0; i < tr->npaths; i++)
+		free(tr->paths[i]);
+	free(tr->paths);
+	free(tr->phash);
+	free(tr->recs);
+	memset(tr, 0, sizeof(*tr));
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * I/O traces: the reads issued by hrr, recorded in a compact binary format
+ * or read from a text trace, to be replayed.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+/* One read, 'ts' is the issue time in ns relative to the start of the run */
+struct trace_rec {
+	uint64_t	 ts;
+	uint64_t	 offset;
+	uint32_t	 file;		/* index in the paths table */
+	uint32_t	 size;
+};
+
+struct trace {
+	struct trace_rec *recs;
+	size_t		 nrecs;
+	size_t		 alloc;
+	char		**paths;
+	size_t		 npaths;
+	size_t		 palloc;
+	uint32_t	*phash;		/* paths index + 1, 0: empty slot */
+	size_t		 phsize;	/* power of 2 */
+};
+
+extern void trace_init(struct trace *);
+extern int trace_add(struct trace *, uint32_t, off_t, size_t, uint64_t);
+extern int trace_path(struct trace *, const char *);
+extern int trace_merge(struct trace *, const struct trace *);
+extern void trace_sort(struct trace *);
+extern int trace_write(const struct trace *, const char *);
+extern int trace_read(struct trace *, const char *);
+extern void trace_free(struct trace *);
+
+#endif /* __TRACE_H__ */
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Minimal io_uring wrapper: a single submission/completion ring pair per
+ * struct uring, driven with raw system calls so that liburing is not needed.
+ * Not thread-safe, each thread is expected to use its own ring.
+ */
+
+#include <sys/types.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#ifdef HAVE_IO_URING
+
+#define load_acquire(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/* Opcodes which io_uring_probe can describe */
+#define PROBE_OPS		256
+
+static int prep_rw(struct uring *, uint8_t, int, void *, size_t, off_t,
+    uint64_t);
+
+int
+uring_init(struct uring *r, unsigned entries)
+{
+	struct io_uring_params	 p;
+	unsigned char		*sq, *cq;
+	int			 fd, serrno;
+
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+	r->fd = -1;
+
+	fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+	if (fd == -1)
+		return (-1);
+
+	r->fd = fd;
+	r->entries = p.sq_entries;
+	r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_sz = p.cq_off.cqes
+	    + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_ring_sz > r->sq_ring_sz)
+			r->sq_ring_sz = r->cq_ring_sz;
+		r->cq_ring_sz = r->sq_ring_sz;
+	}
+
+	r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED)
+		goto fail;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ring = r->sq_ring;
+	else {
+		r->cq_ring = mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED) {
+			r->cq_ring = NULL;
+			goto fail;
+		}
+	}
+
+	r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_sz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		goto fail;
+	}
+
+	sq = r->sq_ring;
+	r->sq_head = (unsigned *) (sq + p.sq_off.head);
+	r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *) (sq + p.sq_off.array);
+	r->sq_local_tail = *r->sq_tail;
+
+	cq = r->cq_ring;
+	r->cq_head = (unsigned *) (cq + p.cq_off.head);
+	r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+	r->cqes = cq + p.cq_off.cqes;
+
+	return (0);
+
+fail:
+	serrno = errno;
+	if (r->sq_ring == MAP_FAILED)
+		r->sq_ring = NULL;
+	uring_exit(r);
+	errno = serrno;
+
+	return (-1);
+}
+
+
+void
+uring_exit(struct uring *r)
+{
+	if (r->sqes != NULL)
+		munmap(r->sqes, r->sqes_sz);
+	if (r->cq_ring != NULL && r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_sz);
+	if (r->sq_ring != NULL)
+		munmap(r->sq_ring, r->sq_ring_sz);
+	if (r->fd != -1)
+		close(r->fd);
+
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+}
+
+
+/*
+ * Checks that the reads & writes used by uring_prep_read() & uring_prep_write()
+ * are supported: IORING_OP_READ/WRITE appeared after io_uring itself (with
+ * IORING_REGISTER_PROBE, which fails with EINVAL on older kernels).
+ */
+int
+uring_probe(struct uring *r)
+{
+	struct io_uring_probe	*p;
+	int			 rc;
+
+	p = calloc(1, sizeof(*p) + PROBE_OPS * sizeof(p->ops[0]));
+	if (p == NULL)
+		return (-1);
+
+	rc = (int) syscall(__NR_io_uring_register, r->fd,
+	    IORING_REGISTER_PROBE, p, PROBE_OPS);
+	if (rc == 0 && (p->last_op < IORING_OP_READ
+	    || p->last_op < IORING_OP_WRITE
+	    || !(p->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+	    || !(p->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)))
+		rc = -1;
+	free(p);
+	if (rc == -1)
+		errno = EOPNOTSUPP;
+
+	return (rc);
+}
+
+
+/*
+ * Queues a read (or write) of 'len' bytes at 'offset' from (to) 'fd' to
+ * (from) 'buf', 'udata' is returned with the completion.  Fails with EBUSY
+ * when the submission ring is full.
+ */
+int
+uring_prep_read(struct uring *r, int fd, void *buf, size_t len, off_t offset,
+    uint64_t udata)
+{
+	return (prep_rw(r, IORING_OP_READ, fd, buf, len, offset, udata));
+}
+
+
+int
+uring_prep_write(struct uring *r, int fd, const void *buf, size_t len,
+    off_t offset, uint64_t udata)
+{
+	return (prep_rw(r, IORING_OP_WRITE, fd, (void *) (uintptr_t) buf, len,
+	    offset, udata));
+}
+
+
+int
+prep_rw(struct uring *r, uint8_t opcode, int fd, void *buf, size_t len,
+    off_t offset, uint64_t udata)
+{
+	struct io_uring_sqe	*sqe;
+	unsigned		 idx;
+
+	if (r->sq_local_tail - load_acquire(r->sq_head) >= r->entries) {
+		errno = EBUSY;
+		return (-1);
+	}
+
+	idx = r->sq_local_tail & *r->sq_mask;
+	sqe = (struct io_uring_sqe *) r->sqes + idx;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->off = (uint64_t) offset;
+	sqe->addr = (uint64_t) (uintptr_t) buf;
+	sqe->len = (uint32_t) len;
+	sqe->user_data = udata;
+
+	r->sq_array[idx] = idx;
+	r->sq_local_tail++;
+	r->pending++;
+
+	return (0);
+}
+
+
+/*
+ * Submits all the queued requests in a single system call & waits for at
+ * least 'wait' completions.
+ */
+int
+uring_submit(struct uring *r, unsigned wait)
+{
+	unsigned	 n = r->pending;
+	int		 rc;
+
+	store_release(r->sq_tail, r->sq_local_tail);
+
+	do {
+		rc = (int) syscall(__NR_io_uring_enter, r->fd, n, wait,
+		    wait > 0 ? IORING_ENTER_GETEVENTS : 0U, NULL, 0);
+	} while (rc == -1 && errno == EINTR);
+
+	if (rc == -1)
+		return (-1);
+
+	r->pending -= (unsigned) rc;
+
+	return (rc);
+}
+
+
+/*
+ * Fetches one completion, returns 1 if one was available (with its user data
+ * & result, a negated errno value on failure), 0 otherwise.
+ */
+int
+uring_reap(struct uring *r, uint64_t *udata, int32_t *res)
+{
+	struct io_uring_cqe	*cqe;
+	unsigned		 head = *r->cq_head;
+
+	if (head == load_acquire(r->cq_tail))
+		return (0);
+
+	cqe = (struct io_uring_cqe *) r->cqes + (head & *r->cq_mask);
+	*udata = cqe->user_data;
+	*res = cqe->res;
+	store_release(r->cq_head, head + 1);
+
+	return (1);
+}
+
+#else /* !HAVE_IO_URING */
+
+int
+uring_init(struct uring *r, unsigned entries)
+{
+	(void) entries;
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+	errno = ENOSYS;
+
+	return (-1);
+}
+
+
+void
+uring_exit(struct uring *r)
+{
+	r->fd = -1;
+}
+
+
+int
+uring_probe(struct uring *r)
+{
+	(void) r;
+	errno = ENOSYS;
+
+	return (-1);
+}
+
+
+int
+uring_prep_read(struct uring *r, int fd, void *buf, size_t len, off_t offset,
+    uint64_t udata)
+{
+	(void) r; (void) fd; (void) buf; (void) len; (void) offset;
+	(void) udata;
+	errno = ENOSYS;
+
+	return (-1);
+}
+
+
+int
+uring_prep_write(struct uring *r, int fd, const void *buf, size_t len,
+    off_t offset, uint64_t udata)
+{
+	(void) r; (void) fd; (void) buf; (void) len; (void) offset;
+	(void) udata;
+	errno = ENOSYS;
+
+	return (-1);
+}
+
+
+int
+uring_submit(struct uring *r, unsigned wait)
+{
+	(void) r; (void) wait;
+	errno = ENOSYS;
+
+	return (-1);
+}
+
+
+int
+uring_reap(struct uring *r, uint64_t *udata, int32_t *res)
+{
+	(void) r; (void) udata; (void) res;
+
+	return (0);
+}
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Minimal io_uring wrapper (raw system calls, no liburing dependency).
+ */
+
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+struct uring {
+	int		 fd;
+	unsigned	 entries;
+	unsigned	 pending;	/* SQEs queued, not yet submitted */
+	/* Submission ring */
+	unsigned	*sq_head;
+	unsigned	*sq_tail;
+	unsigned	*sq_mask;
+	unsigned	*sq_array;
+	void		*sqes;
+	unsigned	 sq_local_tail;
+	/* Completion ring */
+	unsigned	*cq_head;
+	unsigned	*cq_tail;
+	unsigned	*cq_mask;
+	void		*cqes;
+	/* Mappings */
+	void		*sq_ring;
+	size_t		 sq_ring_sz;
+	void		*cq_ring;
+	size_t		 cq_ring_sz;
+	size_t		 sqes_sz;
+};
+
+/*
+ * All functions returning an int return 0 (or a count) on success & -1 with
+ * errno set on failure.  uring_init() fails with ENOSYS when io_uring is not
+ * supported (by the system or this build), uring_probe() with EOPNOTSUPP when
+ * the kernel lacks the read & write operations.
+ */
+extern int uring_init(struct uring *, unsigned);
+extern void uring_exit(struct uring *);
+extern int uring_probe(struct uring *);
+extern int uring_prep_read(struct uring *, int, void *, size_t, off_t,
+    uint64_t);
+extern int uring_prep_write(struct uring *, int, const void *, size_t, off_t,
+    uint64_t);
+extern int uring_submit(struct uring *, unsigned);
+extern int uring_reap(struct uring *, uint64_t *, int32_t *);
+
+#endif /* __URING_H__ */
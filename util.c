@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Small helpers shared by the tools: sizes parsing & monotonic clock.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "errwarn.h"
+#include "util.h"
+
+
+/*
+ * Bytes, with an optional K, M, G or T (binary) suffix, returns 0 or -1
+ * with errno set to EINVAL
+ */
+int
+scan_size(const char *spec, unsigned long long *n)
+{
+	char	*ep;
+	int	 shift = 0;
+
+	errno = 0;
+	*n = strtoull(spec, &ep, 10);
+	switch (*ep) {
+	case 'T': case 't':
+		shift += 10;
+		/* FALLTHROUGH */
+	case 'G': case 'g':
+		shift += 10;
+		/* FALLTHROUGH */
+	case 'M': case 'm':
+		shift += 10;
+		/* FALLTHROUGH */
+	case 'K': case 'k':
+		shift += 10;
+		ep++;
+		break;
+	default:
+		break;
+	}
+	if (errno != 0 || ep == spec || *ep != '\0'
+	    || *n > (~0ULL >> shift)) {
+		errno = EINVAL;
+		return (-1);
+	}
+	*n <<= shift;
+
+	return (0);
+}
+
+
+/* As scan_size(), exits on an invalid size */
+unsigned long long
+parse_size(const char *spec)
+{
+	unsigned long long n;
+
+	if (scan_size(spec, &n) == -1)
+		error(1, -1, "Invalid size: '%s'", spec);
+
+	return (n);
+}
+
+
+/* Monotonic clock, in nanoseconds */
+uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Parallel directory trees traversal.  Each thread takes the most recently
+ * found directory from its own queue (depth first, for locality) or, when
+ * it is empty, the oldest one of another thread queue (likely the largest
+ * subtree left).  The files are opened relative to their directory, with
+ * O_NOATIME when permitted.  Symbolic links are followed for the roots only,
+ * not in the directories.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE	/* O_NOATIME, fdopendir(), openat() */
+#endif /* __linux__ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "errwarn.h"
+#include "walk.h"
+
+#ifndef O_NOATIME
+#define O_NOATIME	0
+#endif /* O_NOATIME */
+
+struct walk_dir {
+	char			*path;
+	struct walk_dir		*prev;
+	struct walk_dir		*next;
+};
+
+/* Directories found by a thread, newest at the head */
+struct walk_queue {
+	pthread_mutex_t		 lock;
+	struct walk_dir		*head;
+	struct walk_dir		*tail;
+};
+
+struct walker {
+	const struct walk_ops	*ops;
+	void			*arg;
+	int			 nthreads;
+	struct walk_queue	*queues;
+	pthread_mutex_t		 lock;		/* for the fields below */
+	pthread_cond_t		 cond;
+	unsigned long		 pending;	/* queued or being read */
+	unsigned long		 npushed;
+	int			 noatime;	/* O_NOATIME still tried */
+};
+
+struct walk_thread {
+	struct walker		*w;
+	int			 id;
+	pthread_t		 tid;
+};
+
+static void push(struct walker *, int, char *);
+static char *pop(struct walker *, int);
+static void *worker(void *);
+static void read_dir(struct walker *, int, char *);
+static int open_file(struct walker *, int, const char *, int);
+
+
+/*
+ * Walks the trees (& files) in 'roots' with 'nthreads' threads, calling the
+ * 'ops' callbacks with 'arg'.  Returns 0, or ENOMEM (nothing done).  The
+ * calling thread does the walk if no thread can be started.
+ */
+int
+walk(const char *const *roots, int nroots, int nthreads,
+    const struct walk_ops *ops, void *arg)
+{
+	struct walker		 w;
+	struct walk_thread	*threads;
+	struct stat		 st;
+	char			*p;
+	int			 i, t, fd;
+
+	memset(&w, 0, sizeof(w));
+	w.ops = ops;
+	w.arg = arg;
+	w.nthreads = nthreads;
+	w.noatime = O_NOATIME != 0;
+	w.queues = calloc((size_t) nthreads, sizeof(*w.queues));
+	threads = calloc((size_t) nthreads, sizeof(*threads));
+	if (w.queues == NULL || threads == NULL) {
+		free(w.queues);
+		free(threads);
+		return (ENOMEM);
+	}
+	pthread_mutex_init(&w.lock, NULL);
+	pthread_cond_init(&w.cond, NULL);
+	for (t = 0; t < nthreads; t++)
+		pthread_mutex_init(&w.queues[t].lock, NULL);
+
+	/* Files given as roots are handled right away, as a directory */
+	for (i = 0; i < nroots; i++) {
+		if (stat(roots[i], &st) == -1) {
+			warning(errno, "Unable to stat '%s'", roots[i]);
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			p = strdup(roots[i]);
+			if (p == NULL)
+				error(2, errno, "Unable to allocate memory");
+			push(&w, i % nthreads, p);
+			continue;
+		}
+		if (!S_ISREG(st.st_mode)) {
+			warning(-1, "Skipping '%s': not a regular file or a "
+			    "directory", roots[i]);
+			continue;
+		}
+		fd = open_file(&w, AT_FDCWD, roots[i], 0);
+		if (fd == -1) {
+			warning(errno, "Unable to open '%s'", roots[i]);
+			continue;
+		}
+		if (fstat(fd, &st) == -1)
+			warning(errno, "Unable to stat '%s'", roots[i]);
+		else
+			ops->file(arg, NULL, roots[i], fd, &st);
+		if (close(fd) == -1)
+			warning(errno, "Problem closing '%s'", roots[i]);
+	}
+
+	for (t = 0; t < nthreads; t++) {
+		threads[t].w = &w;
+		threads[t].id = t;
+		if (pthread_create(&threads[t].tid, NULL, worker,
+		    &threads[t]) != 0)
+			break;
+	}
+	/* Whatever was started finishes the walk */
+	if (t == 0)
+		worker(&threads[0]);
+	while (t-- > 0)
+		pthread_join(threads[t].tid, NULL);
+
+	for (t = 0; t < nthreads; t++)
+		pthread_mutex_destroy(&w.queues[t].lock);
+	pthread_cond_destroy(&w.cond);
+	pthread_mutex_destroy(&w.lock);
+	free(w.queues);
+	free(threads);
+
+	return (0);
+}
+
+
+void
+push(struct walker *w, int id, char *path)
+{
+	struct walk_queue	*q = &w->queues[id];
+	struct walk_dir		*d;
+
+	d = malloc(sizeof(*d));
+	if (d == NULL)
+		error(2, errno, "Unable to allocate memory");
+	d->path = path;
+	d->prev = NULL;
+
+	/* Pending before it can be taken, announced once it can be */
+	pthread_mutex_lock(&w->lock);
+	w->pending++;
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_mutex_lock(&q->lock);
+	d->next = q->head;
+	if (q->head != NULL)
+		q->head->prev = d;
+	else
+		q->tail = d;
+	q->head = d;
+	pthread_mutex_unlock(&q->lock);
+
+	pthread_mutex_lock(&w->lock);
+	w->npushed++;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+
+/* Newest directory of the thread own queue, else oldest of another one */
+char *
+pop(struct walker *w, int id)
+{
+	struct walk_queue	*q;
+	struct walk_dir		*d = NULL;
+	char			*path;
+	int			 i;
+
+	for (i = 0; i < w->nthreads && d == NULL; i++) {
+		q = &w->queues[(id + i) % w->nthreads];
+		pthread_mutex_lock(&q->lock);
+		if (i == 0 && q->head != NULL) {
+			d = q->head;
+			q->head = d->next;
+			if (q->head != NULL)
+				q->head->prev = NULL;
+			else
+				q->tail = NULL;
+		} else if (i > 0 && q->tail != NULL) {
+			d = q->tail;
+			q->tail = d->prev;
+			if (q->tail != NULL)
+				q->tail->next = NULL;
+			else
+				q->head = NULL;
+		}
+		pthread_mutex_unlock(&q->lock);
+	}
+	if (d == NULL)
+		return (NULL);
+
+	path = d->path;
+	free(d);
+
+	return (path);
+}
+
+
+void *
+worker(void *arg)
+{
+	struct walk_thread	*self = arg;
+	struct walker		*w = self->w;
+	unsigned long		 seen;
+	char			*path;
+
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		seen = w->npushed;
+		pthread_mutex_unlock(&w->lock);
+
+		path = pop(w, self->id);
+		if (path != NULL) {
+			read_dir(w, self->id, path);
+			pthread_mutex_lock(&w->lock);
+			if (--w->pending == 0)
+				pthread_cond_broadcast(&w->cond);
+			pthread_mutex_unlock(&w->lock);
+			continue;
+		}
+
+		/* Nothing to take: done, or wait for new directories */
+		pthread_mutex_lock(&w->lock);
+		while (w->pending > 0 && w->npushed == seen)
+			pthread_cond_wait(&w->cond, &w->lock);
+		if (w->pending == 0) {
+			pthread_mutex_unlock(&w->lock);
+			break;
+		}
+		pthread_mutex_unlock(&w->lock);
+	}
+
+	return (NULL);
+}
+
+
+/* Queues the sub-directories & handles the files of the directory */
+void
+read_dir(struct walker *w, int id, char *path)
+{
+	struct dirent	*de;
+	struct stat	 st;
+	DIR		*dir;
+	void		*ctx = NULL;
+	char		 child[PATH_MAX], *p;
+	int		 dfd, fd, isdir, isreg;
+
+	dfd = open_file(w, AT_FDCWD, path, O_DIRECTORY);
+	if (dfd == -1 || (dir = fdopendir(dfd)) == NULL) {
+		warning(errno, "Unable to open directory '%s'", path);
+		if (dfd != -1)
+			close(dfd);
+		free(path);
+		return;
+	}
+
+	if (w->ops->enter != NULL)
+		ctx = w->ops->enter(w->arg, path);
+
+	while ((de = readdir(dir)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0
+		    || strcmp(de->d_name, "..") == 0)
+			continue;
+
+		if ((size_t) snprintf(child, sizeof(child), "%s/%s", path,
+		    de->d_name) >= sizeof(child)) {
+			warning(ENAMETOOLONG, "Skipping '%s/%s'", path,
+			    de->d_name);
+			continue;
+		}
+
+		/* The entry type saves a stat() when the filesystem has it */
+		isdir = isreg = 0;
+#ifdef _DIRENT_HAVE_D_TYPE
+		isdir = de->d_type == DT_DIR;
+		isreg = de->d_type == DT_REG;
+		if (de->d_type == DT_UNKNOWN) {
+#else
+		{
+#endif /* _DIRENT_HAVE_D_TYPE */
+			if (fstatat(dfd, de->d_name, &st,
+			    AT_SYMLINK_NOFOLLOW) == -1) {
+				warning(errno, "Unable to stat '%s'", child);
+				continue;
+			}
+			isdir = S_ISDIR(st.st_mode);
+			isreg = S_ISREG(st.st_mode);
+		}
+
+		if (isdir) {
+			p = strdup(child);
+			if (p == NULL)
+				error(2, errno, "Unable to allocate memory");
+			push(w, id, p);
+			continue;
+		}
+		if (!isreg)
+			continue;
+
+		fd = open_file(w, dfd, de->d_name, O_NOFOLLOW);
+		if (fd == -1) {
+			warning(errno, "Unable to open '%s'", child);
+			continue;
+		}
+		if (fstat(fd, &st) == -1)
+			warning(errno, "Unable to stat '%s'", child);
+		else
+			w->ops->file(w->arg, ctx, child, fd, &st);
+		if (close(fd) == -1)
+			warning(errno, "Problem closing '%s'", child);
+	}
+	closedir(dir);
+
+	if (w->ops->leave != NULL)
+		w->ops->leave(w->arg, ctx, path);
+	free(path);
+}
+
+
+/*
+ * Read-only, with O_NOATIME until it fails with EPERM (only allowed for the
+ * owner of the files), in which case it is no longer tried.
+ */
+int
+open_file(struct walker *w, int dfd, const char *name, int flags)
+{
+	int fd = -1;
+
+	if (__atomic_load_n(&w->noatime, __ATOMIC_RELAXED)) {
+		fd = openat(dfd, name, O_RDONLY | O_NOATIME | flags);
+		if (fd != -1 || errno != EPERM)
+			return (fd);
+		__atomic_store_n(&w->noatime, 0, __ATOMIC_RELAXED);
+	}
+
+	return (openat(dfd, name, O_RDONLY | flags));
+}
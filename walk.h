@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2006-2015, Loic Tortay <tortay@cc.in2p3.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Parallel directory trees traversal: the directories are spread over a
+ * pool of threads (each working from its own queue & stealing from the
+ * others when idle), the regular files of a directory are handled by the
+ * thread reading that directory.
+ */
+
+#ifndef __WALK_H__
+#define __WALK_H__
+
+#include <sys/stat.h>
+
+struct walk_ops {
+	/* Per directory state (or NULL), before its files */
+	void	*(*enter)(void *, const char *);
+	/* For each regular file, opened read-only, from any thread */
+	void	 (*file)(void *, void *, const char *, int,
+		    const struct stat *);
+	/* Once the files (not the sub-directories) of a directory are done */
+	void	 (*leave)(void *, void *, const char *);
+};
+
+extern int walk(const char *const *, int, int, const struct walk_ops *,
+    void *);
+
+#endif /* __WALK_H__ */